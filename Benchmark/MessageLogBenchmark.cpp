@@ -0,0 +1,67 @@
+// Throughput of durable appends to MessageLog on local disk.
+// Every writer waits until its record is committed, so the numbers show how well fdatasync is shared between writers.
+//
+// Usage: MessageLogBenchmark [directory] [messages per run] [message size]
+#include <MessageLog.hpp>
+
+static void runBenchmark(const MessageLogConfig& config, std::size_t writers, std::size_t messages, std::size_t messageSize)
+{
+    std::filesystem::remove_all(config.directory);
+
+    double seconds              = 0.0;
+    uint64_t commits            = 0;
+    const std::size_t perWriter = messages / writers;
+    {
+        MessageLog log(config);
+        const std::vector<uint8_t> body(messageSize, 0x5A);
+
+        const auto start = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> threads;
+        for (std::size_t w = 0; w < writers; ++w)
+        {
+            threads.emplace_back([&log, &body, perWriter, w]() {
+                for (std::size_t i = 0; i < perWriter; ++i)
+                {
+                    log.appendDurable(static_cast<uint32_t>(w), i, body.data(), body.size());
+                }
+            });
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        commits = log.getCommitsCount();
+    }
+    std::filesystem::remove_all(config.directory);
+
+    const double total = static_cast<double>(perWriter * writers);
+    std::cout << "writers: " << std::setw(3) << writers << "  msg/s: " << std::setw(10) << static_cast<uint64_t>(total / seconds)
+              << "  MB/s: " << std::setw(8) << std::fixed << std::setprecision(2) << total * static_cast<double>(messageSize) / seconds / 1e6
+              << "  fdatasync: " << std::setw(6) << commits << "  msg/fdatasync: " << std::setprecision(1) << total / static_cast<double>(std::max<uint64_t>(commits, 1))
+              << '\n';
+}
+
+int main(int argc, char* argv[])
+{
+    MessageLogConfig config;
+    config.directory              = argc > 1 ? argv[1] : "MessageLogBenchmark";
+    const std::size_t messages    = argc > 2 ? std::stoul(argv[2]) : 20000;
+    const std::size_t messageSize = argc > 3 ? std::stoul(argv[3]) : 256;
+
+    std::cout << "MessageLog: " << messages << " durable appends of " << messageSize << " bytes in " << config.directory << '\n';
+
+    for (const auto interval : {std::chrono::microseconds(0), std::chrono::microseconds(1000)})
+    {
+        std::cout << "-- commit interval " << interval.count() << "us\n";
+        config.commitInterval = interval;
+        for (std::size_t writers : {1u, 4u, 16u, 64u})
+        {
+            runBenchmark(config, writers, writers == 1 ? messages / 10 : messages, messageSize);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,147 @@
+// Latency of small control round trips over a TCP loopback connection which is saturated by bulk echo traffic.
+// It is run twice: with every message in the NORMAL lane, which is the former single FIFO queue, and with pings
+// in the CONTROL lane and bulk data in the BULK lane.
+//
+// Usage: PriorityBenchmark [pings] [bulk message size] [bulk messages in flight]
+#include <Network/Connection.hpp>
+#include <functional>
+#include <iomanip>
+
+static uint64_t nowNanoseconds()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+static void runBenchmark(const char* mode, Network::MessagePriority pingPriority, Network::MessagePriority bulkPriority, std::size_t pings,
+                         std::size_t bulkSize, std::size_t bulkWindow)
+{
+    boost::asio::io_service serverService, clientService;
+    auto serverWork = boost::asio::make_work_guard(serverService);
+    auto clientWork = boost::asio::make_work_guard(clientService);
+
+    boost::asio::ip::tcp::acceptor acceptor(serverService, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+    Network::SafeQueue<Network::Message> serverIn, clientIn;
+    std::shared_ptr<Network::Connection> serverConnection;
+
+    acceptor.async_accept([&](std::error_code ec, boost::asio::ip::tcp::socket socket) {
+        if (!ec)
+        {
+            serverConnection = std::make_shared<Network::Connection>(Network::Connection::OwnerType::SERVER, serverService,
+                                                                     Network::Connection::Socket(std::move(socket)), serverIn);
+            serverConnection->connectToClient();
+        }
+    });
+
+    auto clientConnection = std::make_shared<Network::Connection>(Network::Connection::OwnerType::CLIENT, clientService,
+                                                                  Network::Connection::Socket(clientService), clientIn);
+    clientConnection->connectToServer(std::vector<Network::Connection::Endpoint>{acceptor.local_endpoint()});
+
+    std::thread serverThread([&]() { serverService.run(); });
+    std::thread clientThread([&]() { clientService.run(); });
+
+    // Plays the role of Server::update: echoes every message back with its priority
+    std::thread echoThread([&]() {
+        while (true)
+        {
+            serverIn.wait();
+            while (!serverIn.empty())
+            {
+                auto msg = serverIn.pop_front();
+                if (!msg.remote)
+                {
+                    return;
+                }
+                msg.remote->send(msg);
+            }
+        }
+    });
+
+    Network::Message ping;
+    ping.header.id       = Network::MessageType::LoginRequest;
+    ping.header.priority = pingPriority;
+    ping.body.resize(sizeof(uint64_t));
+
+    Network::Message bulk;
+    bulk.header.id       = Network::MessageType::MessageStoreRequest;
+    bulk.header.priority = bulkPriority;
+    bulk.body.resize(bulkSize, 0x42);
+
+    auto sendPing = [&]() {
+        const uint64_t sendTime = nowNanoseconds();
+        std::memcpy(ping.body.data(), &sendTime, sizeof(sendTime));
+        clientConnection->send(ping);
+    };
+
+    const auto start = std::chrono::steady_clock::now();
+
+    std::size_t bulkInFlight = 0, bulkEchoed = 0;
+    for (; bulkInFlight < bulkWindow; ++bulkInFlight)
+    {
+        clientConnection->send(bulk);
+    }
+    sendPing();
+
+    // Every ping is sent when the previous one comes back, the bulk window is kept full until the last ping
+    std::vector<uint64_t> latencies;
+    latencies.reserve(pings);
+    while (latencies.size() < pings || bulkInFlight > 0)
+    {
+        clientIn.wait();
+        while (!clientIn.empty())
+        {
+            const auto reply = clientIn.pop_front();
+            if (reply.header.id == Network::MessageType::LoginRequest)
+            {
+                uint64_t sendTime = 0;
+                std::memcpy(&sendTime, reply.body.data(), sizeof(sendTime));
+                latencies.push_back(nowNanoseconds() - sendTime);
+                if (latencies.size() < pings)
+                {
+                    sendPing();
+                }
+                continue;
+            }
+
+            --bulkInFlight;
+            ++bulkEchoed;
+            if (latencies.size() < pings)
+            {
+                clientConnection->send(bulk);
+                ++bulkInFlight;
+            }
+        }
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    serverIn.push_back(Network::Message());
+    echoThread.join();
+
+    serverService.stop();
+    clientService.stop();
+    serverThread.join();
+    clientThread.join();
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        return static_cast<double>(latencies[static_cast<std::size_t>(p * static_cast<double>(latencies.size() - 1))]) / 1e3;
+    };
+
+    std::cout << std::setw(12) << mode << "  ping p50: " << std::fixed << std::setprecision(1) << std::setw(9) << percentile(0.5)
+              << "us  p99: " << std::setw(9) << percentile(0.99) << "us  bulk: " << std::setw(8)
+              << static_cast<double>(bulkEchoed * bulkSize) / seconds / (1024 * 1024) << " MiB/s\n";
+}
+
+int main(int argc, char* argv[])
+{
+    const std::size_t pings      = argc > 1 ? std::stoul(argv[1]) : 2000;
+    const std::size_t bulkSize   = argc > 2 ? std::stoul(argv[2]) : 64 * 1024;
+    const std::size_t bulkWindow = argc > 3 ? std::stoul(argv[3]) : 64;
+
+    std::cout << "pings: " << pings << "  bulk size: " << bulkSize << "  bulk in flight: " << bulkWindow << '\n';
+
+    runBenchmark("single lane", Network::MessagePriority::NORMAL, Network::MessagePriority::NORMAL, pings, bulkSize, bulkWindow);
+    runBenchmark("lanes", Network::MessagePriority::CONTROL, Network::MessagePriority::BULK, pings, bulkSize, bulkWindow);
+
+    return 0;
+}
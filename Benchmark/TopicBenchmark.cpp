@@ -0,0 +1,160 @@
+// Publishes through TopicIndex while other threads subscribe and unsubscribe at random, compared with the full scan
+// of all connections which messageAllClients does. Subscribers are plain objects, so the cost of the index is measured
+// without the network. The last case puts all subscribers into one hot topic, where every subscribe or unsubscribe
+// copies all of them.
+//
+// Usage: TopicBenchmark [subscribers] [topics] [topics per subscriber] [publishers] [churners] [seconds]
+#include <TopicIndex.hpp>
+#include <iomanip>
+#include <random>
+
+struct Subscriber
+{
+    bool isConnected() const { return true; }
+
+    uint64_t id = 0;
+    std::unordered_set<uint64_t> topics;  // used by the full scan only
+};
+
+// Keeps the visits of subscribers from being optimized out
+static std::atomic<uint64_t> checksumSink = 0;
+
+struct Result
+{
+    double publishes  = 0.0;
+    double deliveries = 0.0;
+    double churnOps   = 0.0;
+};
+
+static Result runIndex(TopicIndex<Subscriber>& index, const std::vector<std::shared_ptr<Subscriber>>& subscribers, uint64_t topicsCount,
+                       std::size_t publishersCount, std::size_t churnersCount, double seconds)
+{
+    std::atomic<bool> running       = true;
+    std::atomic<uint64_t> publishes = 0, deliveries = 0, churnOps = 0;
+
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < publishersCount; ++i)
+    {
+        threads.emplace_back([&, i]() {
+            std::mt19937_64 random(i);
+            uint64_t published = 0, delivered = 0, checksum = 0;
+            while (running)
+            {
+                delivered += index.forEachSubscriber(random() % topicsCount, nullptr, [&checksum](Subscriber& subscriber) { checksum += subscriber.id; });
+                ++published;
+            }
+            publishes += published;
+            deliveries += delivered;
+            checksumSink += checksum;
+        });
+    }
+
+    // Every operation flips one random subscription
+    for (std::size_t i = 0; i < churnersCount; ++i)
+    {
+        threads.emplace_back([&, i]() {
+            std::mt19937_64 random(1000 + i);
+            uint64_t operations = 0;
+            while (running)
+            {
+                const auto& subscriber = subscribers[random() % subscribers.size()];
+                const uint64_t topic   = random() % topicsCount;
+                if (!index.subscribe(topic, subscriber))
+                {
+                    index.unsubscribe(topic, subscriber.get());
+                }
+                ++operations;
+            }
+            churnOps += operations;
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    running = false;
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    return Result{static_cast<double>(publishes) / seconds, static_cast<double>(deliveries) / seconds, static_cast<double>(churnOps) / seconds};
+}
+
+// What messageAllClients would do to reach a topic: visit every connection and check its subscriptions
+static Result runFullScan(const std::deque<std::shared_ptr<Subscriber>>& connections, uint64_t topicsCount, double seconds)
+{
+    std::mt19937_64 random(0);
+    uint64_t published = 0, delivered = 0, checksum = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < std::chrono::duration<double>(seconds))
+    {
+        const uint64_t topic = random() % topicsCount;
+        for (const auto& connection : connections)
+        {
+            if (connection->topics.count(topic) > 0)
+            {
+                checksum += connection->id;
+                ++delivered;
+            }
+        }
+        ++published;
+    }
+
+    checksumSink += checksum;
+
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return Result{static_cast<double>(published) / elapsed, static_cast<double>(delivered) / elapsed, 0.0};
+}
+
+static void print(const char* mode, const Result& result)
+{
+    std::cout << std::setw(22) << mode << "  publishes/s: " << std::setw(10) << static_cast<uint64_t>(result.publishes)
+              << "  deliveries/s: " << std::setw(11) << static_cast<uint64_t>(result.deliveries) << "  churn ops/s: " << std::setw(10)
+              << static_cast<uint64_t>(result.churnOps) << '\n';
+}
+
+int main(int argc, char* argv[])
+{
+    const std::size_t subscribersCount    = argc > 1 ? std::stoul(argv[1]) : 50000;
+    const uint64_t topicsCount            = argc > 2 ? std::stoul(argv[2]) : 10000;
+    const std::size_t topicsPerSubscriber = argc > 3 ? std::stoul(argv[3]) : 20;
+    const std::size_t publishersCount     = argc > 4 ? std::stoul(argv[4]) : 4;
+    const std::size_t churnersCount       = argc > 5 ? std::stoul(argv[5]) : 4;
+    const double seconds                  = argc > 6 ? std::stod(argv[6]) : 3.0;
+
+    std::cout << "subscribers: " << subscribersCount << "  topics: " << topicsCount << "  topics per subscriber: " << topicsPerSubscriber
+              << "  publishers: " << publishersCount << "  churners: " << churnersCount << '\n';
+
+    TopicIndex<Subscriber> index;
+    std::vector<std::shared_ptr<Subscriber>> subscribers;
+    std::deque<std::shared_ptr<Subscriber>> connections;
+    std::mt19937_64 random(42);
+    for (std::size_t i = 0; i < subscribersCount; ++i)
+    {
+        auto subscriber = std::make_shared<Subscriber>();
+        subscriber->id  = i + 1;
+        while (subscriber->topics.size() < std::min<uint64_t>(topicsPerSubscriber, topicsCount))
+        {
+            subscriber->topics.insert(random() % topicsCount);
+        }
+        for (const uint64_t topic : subscriber->topics)
+        {
+            index.subscribe(topic, subscriber);
+        }
+        subscribers.push_back(subscriber);
+        connections.push_back(subscriber);
+    }
+
+    print("full scan, 1 thread", runFullScan(connections, topicsCount, seconds));
+    print("index, no churn", runIndex(index, subscribers, topicsCount, publishersCount, 0, seconds));
+    print("index, churn", runIndex(index, subscribers, topicsCount, publishersCount, churnersCount, seconds));
+
+    TopicIndex<Subscriber> hotIndex;
+    for (const auto& subscriber : subscribers)
+    {
+        hotIndex.subscribe(0, subscriber);
+    }
+    print("one topic, churn", runIndex(hotIndex, subscribers, 1, publishersCount, churnersCount, seconds));
+
+    return 0;
+}
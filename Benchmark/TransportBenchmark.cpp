@@ -0,0 +1,231 @@
+// Echo round trips of Network::Connection over TCP loopback and a Unix domain socket:
+// throughput, CPU time per round trip and round trip latency.
+// The io_context backend is chosen at build time: build once with -DUSE_IO_URING=OFF (epoll) and once with ON to compare.
+//
+// Usage: TransportBenchmark [clients] [messages per client] [message size] [messages in flight per client]
+#include <sys/resource.h>
+
+#include <Network/Connection.hpp>
+#include <Network/LocalEndpoint.hpp>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+
+static double cpuSeconds()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static uint64_t nowNanoseconds()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+template <class Protocol>
+static void runBenchmark(const char* transport, const typename Protocol::endpoint& listenEndpoint, std::size_t clientsCount,
+                         std::size_t messages, std::size_t messageSize, std::size_t window)
+{
+    boost::asio::io_service serverService, clientService;
+    auto serverWork = boost::asio::make_work_guard(serverService);
+    auto clientWork = boost::asio::make_work_guard(clientService);
+
+    Network::ReceiveBufferPool serverPool(serverService, clientsCount);
+    Network::ReceiveBufferPool clientPool(clientService, clientsCount);
+
+    boost::asio::basic_socket_acceptor<Protocol> acceptor(serverService, listenEndpoint);
+    Network::SafeQueue<Network::Message> serverIn;
+    std::vector<std::shared_ptr<Network::Connection>> serverConnections;
+
+    std::function<void()> accept = [&]() {
+        acceptor.async_accept([&](std::error_code ec, typename Protocol::socket socket) {
+            if (ec)
+            {
+                return;
+            }
+
+            auto connection = std::make_shared<Network::Connection>(Network::Connection::OwnerType::SERVER, serverService,
+                                                                    Network::Connection::Socket(std::move(socket)), serverIn, &serverPool);
+            connection->connectToClient(static_cast<uint32_t>(serverConnections.size()));
+            serverConnections.push_back(std::move(connection));
+
+            if (serverConnections.size() < clientsCount)
+            {
+                accept();
+            }
+        });
+    };
+    accept();
+
+    const std::vector<Network::Connection::Endpoint> endpoints{acceptor.local_endpoint()};
+
+    std::vector<std::unique_ptr<Network::SafeQueue<Network::Message>>> clientsIn;
+    std::vector<std::shared_ptr<Network::Connection>> clientConnections;
+    for (std::size_t i = 0; i < clientsCount; ++i)
+    {
+        clientsIn.push_back(std::make_unique<Network::SafeQueue<Network::Message>>());
+        clientConnections.push_back(std::make_shared<Network::Connection>(Network::Connection::OwnerType::CLIENT, clientService,
+                                                                          Network::Connection::Socket(clientService), *clientsIn.back(),
+                                                                          &clientPool));
+        clientConnections.back()->connectToServer(endpoints);
+    }
+
+    std::thread serverThread([&]() { serverService.run(); });
+    std::thread clientThread([&]() { clientService.run(); });
+
+    // Plays the role of Server::update: echoes every message back through the connection it came from
+    std::thread echoThread([&]() {
+        while (true)
+        {
+            serverIn.wait();
+            while (!serverIn.empty())
+            {
+                auto msg = serverIn.pop_front();
+                if (!msg.remote)
+                {
+                    return;
+                }
+                msg.remote->send(msg);
+            }
+        }
+    });
+
+    const double cpuStart = cpuSeconds();
+    const auto start      = std::chrono::steady_clock::now();
+
+    // Every request carries its send time, so the latency is measured on the echoed copy
+    std::vector<std::vector<uint64_t>> latencies(clientsCount);
+    std::vector<std::thread> drivers;
+    for (std::size_t i = 0; i < clientsCount; ++i)
+    {
+        drivers.emplace_back([&, i]() {
+            auto& connection = *clientConnections[i];
+            auto& qIn        = *clientsIn[i];
+            latencies[i].reserve(messages);
+
+            Network::Message request;
+            request.header.id = Network::MessageType::MessageStoreRequest;
+            request.body.resize(std::max(messageSize, sizeof(uint64_t)), 0x42);
+
+            auto sendRequest = [&]() {
+                const uint64_t sendTime = nowNanoseconds();
+                std::memcpy(request.body.data(), &sendTime, sizeof(sendTime));
+                connection.send(request);
+            };
+
+            std::size_t sent = 0;
+            for (; sent < std::min(window, messages); ++sent)
+            {
+                sendRequest();
+            }
+
+            while (latencies[i].size() < messages)
+            {
+                qIn.wait();
+                while (!qIn.empty())
+                {
+                    const auto reply = qIn.pop_front();
+                    uint64_t sendTime = 0;
+                    std::memcpy(&sendTime, reply.body.data(), sizeof(sendTime));
+                    latencies[i].push_back(nowNanoseconds() - sendTime);
+
+                    if (sent < messages)
+                    {
+                        sendRequest();
+                        ++sent;
+                    }
+                }
+            }
+        });
+    }
+    for (auto& driver : drivers)
+    {
+        driver.join();
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const double cpu     = cpuSeconds() - cpuStart;
+    const double total   = static_cast<double>(clientsCount * messages);
+
+    serverIn.push_back(Network::Message());
+    echoThread.join();
+
+    serverService.stop();
+    clientService.stop();
+    serverThread.join();
+    clientThread.join();
+
+    // Pending handlers keep their connections alive, so they have to finish before the pools go away
+    for (auto& connection : serverConnections)
+    {
+        connection->disconnect();
+    }
+    for (auto& connection : clientConnections)
+    {
+        connection->disconnect();
+    }
+    serverConnections.clear();
+    clientConnections.clear();
+    serverWork.reset();
+    clientWork.reset();
+    serverService.restart();
+    clientService.restart();
+    serverService.poll();
+    clientService.poll();
+
+    std::vector<uint64_t> all;
+    for (const auto& clientLatencies : latencies)
+    {
+        all.insert(all.end(), clientLatencies.begin(), clientLatencies.end());
+    }
+    std::sort(all.begin(), all.end());
+    auto percentile = [&all](double p) { return static_cast<double>(all[static_cast<std::size_t>(p * static_cast<double>(all.size() - 1))]) / 1e3; };
+
+    std::cout << std::setw(5) << transport << "  round trips/s: " << std::setw(8) << static_cast<uint64_t>(total / seconds)
+              << "  CPU/round trip: " << std::fixed << std::setprecision(2) << std::setw(7) << cpu / total * 1e6 << "us"
+              << "  p50: " << std::setw(8) << percentile(0.5) << "us  p99: " << std::setw(8) << percentile(0.99) << "us\n";
+}
+
+int main(int argc, char* argv[])
+{
+    const std::size_t clientsCount = argc > 1 ? std::stoul(argv[1]) : 4;
+    const std::size_t messages     = argc > 2 ? std::stoul(argv[2]) : 200000;
+    const std::size_t messageSize  = argc > 3 ? std::stoul(argv[3]) : 64;
+    const std::size_t window       = argc > 4 ? std::stoul(argv[4]) : 32;
+
+#ifdef BOOST_ASIO_HAS_IO_URING
+    const char* backend = "io_uring";
+#else
+    const char* backend = "epoll";
+#endif
+
+    std::cout << "backend: " << backend << "  clients: " << clientsCount << "  messages: " << messages << "  size: " << messageSize << '\n';
+
+    const boost::asio::ip::tcp::endpoint tcpEndpoint(boost::asio::ip::address_v4::loopback(), 0);
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+    // Without a private directory or with a path too long for a socket address only TCP is measured
+    const std::filesystem::path localDirectory = Network::getLocalSocketDirectory();
+    const std::string localPath                = localDirectory.empty() ? std::string() : (localDirectory / "TransportBenchmark.sock").string();
+    const bool hasLocalSocket                  = Network::isValidLocalSocketPath(localPath);
+#endif
+
+    // One message in flight shows the latency, a window of messages shows the throughput
+    for (const std::size_t inFlight : {std::size_t{1}, window})
+    {
+        std::cout << "-- in flight per client: " << inFlight << '\n';
+        runBenchmark<boost::asio::ip::tcp>("tcp", tcpEndpoint, clientsCount, inFlight == 1 ? messages / 10 : messages, messageSize, inFlight);
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+        if (hasLocalSocket)
+        {
+            std::filesystem::remove(localPath);
+            runBenchmark<boost::asio::local::stream_protocol>("unix", boost::asio::local::stream_protocol::endpoint(localPath), clientsCount,
+                                                              inFlight == 1 ? messages / 10 : messages, messageSize, inFlight);
+            std::filesystem::remove(localPath);
+        }
+#endif
+    }
+
+    return 0;
+}
@@ -1,6 +1,7 @@
 #include <Network/Common.hpp>
 
 #include "Network/Connection.hpp"
+#include "Network/LocalEndpoint.hpp"
 #include "Network/Message.hpp"
 #include "Network/SafeQueue.hpp"
 
@@ -13,15 +14,32 @@ public:
 
     virtual ~Client() { disconnect(); }
 
-    bool connect(const std::string& host, const uint16_t port)
+    // Connects through the Unix domain socket of the server when it runs on this host as the same user, otherwise over TCP.
+    // TCP endpoints stay in the list, so the connection falls back to them if the local socket does not answer.
+    bool connect(const std::string& host, const uint16_t port, [[maybe_unused]] bool preferLocal = true)
     {
         try
         {
             boost::asio::ip::tcp::resolver resolver(service);
-            boost::asio::ip::tcp::resolver::results_type endpoints = resolver.resolve(host, std::to_string(port));
-
-            connection = std::make_unique<Network::Connection>(Network::Connection::OwnerType::CLIENT, service,
-                                                               boost::asio::ip::tcp::socket(service), _qMessagesIn);
+            boost::asio::ip::tcp::resolver::results_type results = resolver.resolve(host, std::to_string(port));
+
+            std::vector<Network::Connection::Endpoint> endpoints;
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+            const bool isLocalHost = std::all_of(results.begin(), results.end(),
+                                                 [](const auto& entry) { return entry.endpoint().address().is_loopback(); });
+            const std::string localSocketPath = Network::getLocalSocketPath(port);
+            if (preferLocal && isLocalHost && Network::isOwnLocalSocket(localSocketPath))
+            {
+                endpoints.emplace_back(boost::asio::local::stream_protocol::endpoint(localSocketPath));
+            }
+#endif
+            for (const auto& entry : results)
+            {
+                endpoints.emplace_back(entry.endpoint());
+            }
+
+            connection = std::make_shared<Network::Connection>(Network::Connection::OwnerType::CLIENT, service,
+                                                               Network::Connection::Socket(service), _qMessagesIn);
             connection->connectToServer(endpoints);
             serviceThread = std::thread([this]() { service.run(); });
 
@@ -47,7 +65,7 @@ public:
             serviceThread.join();
         }
 
-        connection.release();
+        connection.reset();
     }
 
     bool isConnected() const
@@ -69,10 +87,10 @@ protected:
     std::thread serviceThread;
 
     // Socket which is connected to a server.
-    boost::asio::ip::tcp::socket socket;
+    Network::Connection::Socket socket;
 
-    // It handles data transfer
-    std::unique_ptr<Network::Connection> connection;
+    // It handles data transfer. Received stream chunks refer to it to return their credit.
+    std::shared_ptr<Network::Connection> connection;
 
 private:
     // Queue of incoming messages from server
@@ -85,7 +103,8 @@ public:
     void registerUser(const std::string& email, const std::string& userName, const std::string& password)
     {
         Network::Message msg;
-        msg.header.id = Network::MessageType::LoginRequest;
+        msg.header.id       = Network::MessageType::LoginRequest;
+        msg.header.priority = Network::MessagePriority::CONTROL;
         msg << email << userName << password;
         send(msg);
     }
@@ -1,11 +1,31 @@
 #pragma once
 #include "Common.hpp"
+
+#include <boost/asio.hpp>
+#include <functional>
+#include <map>
+
 #include "Message.hpp"
+#include "OutboundQueue.hpp"
+#include "ReceiveBufferPool.hpp"
 #include "SafeQueue.hpp"
 
 namespace Network
 {
 
+struct ConnectionConfig
+{
+    // A received frame with a larger body closes the connection, so a peer cannot make us allocate more.
+    // Messages with a larger body are sent as streams. Both sides of a connection are expected to use the same value.
+    std::size_t maxFrameSize = 1024u * 1024u;
+
+    // Received messages other than stream chunks which are waiting for the owner. Every message is counted with
+    // Connection::QUEUED_MESSAGE_OVERHEAD, so many empty frames fill it as well as a few large ones. Above it the connection
+    // stops reading until the owner releases some, so a peer which sends faster than it is served is held back by TCP
+    // flow control. The queue may exceed it by a frame. Zero disables the limit.
+    std::size_t maxQueuedBytes = 4u * 1024u * 1024u;
+};
+
 class Connection : public std::enable_shared_from_this<Connection>
 {
 public:
@@ -15,9 +35,45 @@ public:
         CLIENT,
     };
 
+    // Maximum amount of queued messages which are sent by one gathered write
+    static constexpr std::size_t MAX_WRITE_BATCH = 64;
+    // Bytes after which a batch is closed, so a control reply queued meanwhile does not wait behind a long write
+    static constexpr std::size_t MAX_WRITE_BATCH_BYTES = 256u * 1024u;
+
+    // Streams carry payloads of any size in chunks. The receiver credits the bytes of a stream back to the sender
+    // as they are consumed, so at most STREAM_WINDOW bytes of a stream are in flight or waiting for a handler.
+    // These values are a part of the protocol.
+    static constexpr std::size_t STREAM_CHUNK_SIZE = 64u * 1024u;
+    static constexpr std::size_t STREAM_WINDOW     = 256u * 1024u;
+    // Streams open in one direction at once, including the finished ones whose chunks are not consumed yet
+    static constexpr std::size_t MAX_STREAMS = 16;
+    // Chunks of one stream produced ahead of the socket
+    static constexpr std::size_t MAX_QUEUED_CHUNKS = 2;
+
+    // Memory of a received message besides its frame: the Message itself, the control block of its receive credit
+    // and a slot of the queue
+    static constexpr std::size_t QUEUED_MESSAGE_OVERHEAD = sizeof(Message) + 64u;
+
+    // Any stream socket: TCP or, for clients on the same host, a Unix domain socket
+    using Socket   = boost::asio::generic::stream_protocol::socket;
+    using Endpoint = boost::asio::generic::stream_protocol::endpoint;
+
+    // Writes up to size bytes of a stream into data and returns their amount. Returning less than size ends the stream.
+    // It is called on the strand of the connection whenever the receiver has room for more.
+    using StreamProducer = std::function<std::size_t(uint8_t* data, std::size_t size)>;
+
+    // Reason is empty after disconnect(), the error of the failed read or write, or std::errc::protocol_error for a rejected frame
+    using CloseHandler = std::function<void(const std::error_code& reason)>;
+
 public:
-    Connection(OwnerType parent, boost::asio::io_service& service, boost::asio::ip::tcp::socket socket, SafeQueue<Message>& qIn)
-        : service(service), socket(std::move(socket)), qMessagesIn(qIn)
+    Connection(OwnerType parent, boost::asio::io_service& service, Socket socket, SafeQueue<Message>& qIn,
+               ReceiveBufferPool* receivePool = nullptr, ConnectionConfig cfg = {})
+        : service(service),
+          strand(boost::asio::make_strand(service)),
+          socket(std::move(socket)),
+          qMessagesIn(qIn),
+          receiveBuffer(receivePool ? receivePool->acquire() : ReceiveBuffer(ReceiveBufferPool::DEFAULT_SLOT_SIZE)),
+          config(std::move(cfg))
     {
         owner = parent;
     }
@@ -31,171 +87,564 @@ public:
             if (socket.is_open())
             {
                 id = uid;
-                asyncReadHeader();
+                boost::asio::post(strand, [this, self = shared_from_this()]() { onEstablished(); });
             }
         }
     }
-    void connectToServer(const boost::asio::ip::tcp::resolver::results_type& endpoints)
+    // Endpoints are tried in order until a connection is established
+    void connectToServer(const std::vector<Endpoint>& endpoints)
     {
         if (owner == OwnerType::CLIENT)
         {
-            boost::asio::async_connect(socket, endpoints, [this](std::error_code ec, [[maybe_unused]] boost::asio::ip::tcp::endpoint ep) {
-                if (!ec)
-                {
-                    asyncWriteHeader();
-                }
-            });
+            auto self = shared_from_this();
+            boost::asio::async_connect(socket, endpoints,
+                                       boost::asio::bind_executor(strand, [this, self](std::error_code ec, const Endpoint&) {
+                                           if (!ec)
+                                           {
+                                               onEstablished();
+                                           }
+                                           else
+                                           {
+                                               std::cerr << "[" << id << "]"
+                                                         << " Connect Fail: " << ec.message() << '\n';
+                                           }
+                                       }));
+        }
+    }
+    void connectToServer(const boost::asio::ip::tcp::resolver::results_type& endpoints)
+    {
+        std::vector<Endpoint> genericEndpoints;
+        for (const auto& entry : endpoints)
+        {
+            genericEndpoints.emplace_back(entry.endpoint());
         }
+        connectToServer(genericEndpoints);
     }
 
     void disconnect()
     {
         if (isConnected())
         {
-            boost::asio::post([this]() { socket.close(); });
+            boost::asio::post(strand, [this, self = shared_from_this()]() { close(); });
         }
     }
-    
+
     bool isConnected() const { return socket.is_open(); }
 
+    // Is called once when the socket gets closed by disconnect(), by a failed read or write or by a rejected frame.
+    // Must be set before the connection is started. Closes are not logged, the owner may count them.
+    void setOnClose(CloseHandler handler) { onClose = std::move(handler); }
+
+    // A body larger than ConnectionConfig::maxFrameSize is sent as a stream in the BULK lane
     void send(const Message& msg)
     {
-        boost::asio::post(service, [this, &msg] {
-            bool writingMessage = !qMessagesOut.empty();
-            qMessagesOut.push_back(msg);
-            if (!writingMessage)
-            {
-                asyncWriteHeader();
-            }
+        if (msg.body.size() > config.maxFrameSize)
+        {
+            sendStream(msg.header.id, msg.body, MessagePriority::BULK);
+            return;
+        }
+
+        boost::asio::post(strand, [this, self = shared_from_this(), message = msg]() mutable {
+            message.header.size   = static_cast<uint32_t>(message.body.size());
+            message.header.flags  = 0;
+            message.header.stream = 0;
+            message.remote.reset();
+            message.receiveCredit.reset();
+            qMessagesOut.push(std::move(message));
+            startWriting();
         });
     }
 
+    // The receiver gets the stream as a sequence of messages of type id with STREAM_CHUNK flag, the last one has STREAM_END flag
+    void sendStream(MessageType id, StreamProducer producer, MessagePriority priority = MessagePriority::BULK)
+    {
+        boost::asio::post(strand, [this, self = shared_from_this(), id, priority, producer = std::move(producer)]() mutable {
+            pendingStreams.push_back(OutgoingStream{id, priority, std::move(producer)});
+            pumpStreams();
+            startWriting();
+        });
+    }
+
+    void sendStream(MessageType id, std::vector<uint8_t> payload, MessagePriority priority = MessagePriority::BULK)
+    {
+        sendStream(
+            id,
+            [payload = std::move(payload), offset = std::size_t{0}](uint8_t* data, std::size_t size) mutable {
+                const std::size_t length = std::min(size, payload.size() - offset);
+                if (length > 0)
+                {
+                    std::memcpy(data, payload.data() + offset, length);
+                    offset += length;
+                }
+                return length;
+            },
+            priority);
+    }
+
     inline uint32_t getID() const { return id; }
 
+    // Chunks are frames as well, so they are limited by maxFrameSize too
+    std::size_t getMaxChunkSize() const { return std::max<std::size_t>(1, std::min(STREAM_CHUNK_SIZE, config.maxFrameSize)); }
+
 private:
-    void asyncReadHeader()
+    void close(const std::error_code& reason = {})
     {
-        boost::asio::async_read(socket, boost::asio::buffer(&tempMsg.header, sizeof(MessageHeader)),
-                                [this](std::error_code ec, [[maybe_unused]] std::size_t length) {
-                                    if (!ec)
-                                    {
-                                        if (tempMsg.header.size > 0)
+        boost::system::error_code ignored;
+        socket.close(ignored);
+
+        pendingStreams.clear();
+        outgoingStreams.clear();
+        incomingStreams.clear();
+
+        if (onClose)
+        {
+            std::exchange(onClose, nullptr)(reason);
+        }
+    }
+
+    void onEstablished()
+    {
+        // Small replies must not wait for Nagle's algorithm. Unix domain sockets do not support the option.
+        boost::system::error_code ignored;
+        socket.set_option(boost::asio::ip::tcp::no_delay(true), ignored);
+
+        established = true;
+        asyncRead();
+        startWriting();
+    }
+
+    // Reads as much as the receive buffer can take, so that a single read completes many small messages.
+    // The remainder of a body larger than the receive buffer is read directly into the message.
+    void asyncRead()
+    {
+        if (isReceiveQueueFull())
+        {
+            readPaused = true;  // is resumed by releaseQueued()
+            return;
+        }
+
+        auto self = shared_from_this();
+        if (headerReceived && tempMsg.body.size() - bodyReceived >= receiveBuffer.size())
+        {
+            boost::asio::async_read(socket, boost::asio::buffer(tempMsg.body.data() + bodyReceived, tempMsg.body.size() - bodyReceived),
+                                    boost::asio::bind_executor(strand, [this, self](std::error_code ec, std::size_t) {
+                                        if (!ec)
                                         {
-                                            tempMsg.body.resize(tempMsg.header.size);
-                                            asyncReadBody();
+                                            headerReceived = false;
+                                            addToIncomingMessageQueue();
+                                            asyncRead();
                                         }
                                         else
                                         {
-                                            addToIncomingMessageQueue();
+                                            close(ec);
                                         }
-                                    }
-                                    else
-                                    {
-                                        std::cerr << "[" << id << "]"
-                                                  << " Read Header Fail\n";
-                                        socket.close();
-                                    }
-                                });
-    }
-
-    void asyncReadBody()
-    {
-        boost::asio::async_read(socket, boost::asio::buffer(tempMsg.body.data(), tempMsg.body.size()),
-                                [this](std::error_code ec, [[maybe_unused]] std::size_t length) {
-                                    if (!ec)
-                                    {
-                                        addToIncomingMessageQueue();
-                                    }
-                                    else
-                                    {
-                                        std::cerr << "[" << id << "]"
-                                                  << " Read Body Fail\n";
-                                        socket.close();
-                                    }
-                                });
-    }
-
-    void asyncWriteHeader()
-    {
-        boost::asio::async_write(socket, boost::asio::buffer(&qMessagesOut.front().header, sizeof(MessageHeader)),
-                                 [this](std::error_code ec, [[maybe_unused]] std::size_t length) {
-                                     if (!ec)
-                                     {
-                                         if (qMessagesOut.front().body.size() > 0)
-                                         {
-                                             asyncWriteBody();
-                                         }
-                                         else
-                                         {
-                                             qMessagesOut.pop_front();
+                                    }));
+            return;
+        }
 
-                                             if (!qMessagesOut.empty())
-                                             {
-                                                 asyncWriteHeader();
-                                             }
-                                         }
-                                     }
-                                     else
-                                     {
-                                         std::cerr << "[" << id << "]"
-                                                   << " Write Header Fail\n";
-                                         socket.close();
-                                     }
-                                 });
+        receiveBuffer.asyncReadSome(socket, readEnd,
+                                    boost::asio::bind_executor(strand, [this, self](std::error_code ec, std::size_t length) {
+                                        if (!ec)
+                                        {
+                                            readEnd += length;
+                                            if (processReceivedData())
+                                            {
+                                                asyncRead();
+                                            }
+                                        }
+                                        else
+                                        {
+                                            close(ec);
+                                        }
+                                    }));
     }
 
-    void asyncWriteBody()
+    // Extracts complete messages from the receive buffer until the receive queue is full and moves the rest to its beginning.
+    // Returns false when the connection is closed because of a rejected frame.
+    bool processReceivedData()
     {
-        boost::asio::async_write(socket, boost::asio::buffer(qMessagesOut.front().body.data(), qMessagesOut.front().body.size()),
-                                 [this](std::error_code ec, [[maybe_unused]] std::size_t length) {
-                                     if (!ec)
+        const uint8_t* data = receiveBuffer.data();
+        std::size_t offset  = 0;
+
+        while (true)
+        {
+            if (!headerReceived)
+            {
+                if (readEnd - offset < sizeof(MessageHeader) || isReceiveQueueFull())
+                {
+                    break;
+                }
+
+                std::memcpy(&tempMsg.header, data + offset, sizeof(MessageHeader));
+                offset += sizeof(MessageHeader);
+                if (!acceptFrameHeader())
+                {
+                    close(std::make_error_code(std::errc::protocol_error));
+                    return false;
+                }
+                tempMsg.body.resize(tempMsg.header.size);
+                bodyReceived   = 0;
+                headerReceived = true;
+            }
+
+            const std::size_t chunk = std::min(readEnd - offset, tempMsg.body.size() - bodyReceived);
+            if (chunk > 0)
+            {
+                std::memcpy(tempMsg.body.data() + bodyReceived, data + offset, chunk);
+                offset += chunk;
+                bodyReceived += chunk;
+            }
+
+            if (bodyReceived < tempMsg.body.size())
+            {
+                break;
+            }
+
+            headerReceived = false;
+            addToIncomingMessageQueue();
+        }
+
+        std::memmove(receiveBuffer.data(), data + offset, readEnd - offset);
+        readEnd -= offset;
+        return true;
+    }
+
+    // Checks a received header before its body is allocated: the size of a frame is limited by maxFrameSize,
+    // the size of a chunk by getMaxChunkSize() and the credit of its stream. Only the last chunk of a stream may be
+    // empty, otherwise a peer could queue chunks without using the credit.
+    bool acceptFrameHeader()
+    {
+        const MessageHeader& header = tempMsg.header;
+        if (header.flags & MessageFlags::STREAM_CREDIT)
+        {
+            return header.size == sizeof(uint32_t);
+        }
+        if (!(header.flags & MessageFlags::STREAM_CHUNK))
+        {
+            return header.size <= config.maxFrameSize;
+        }
+
+        auto it = incomingStreams.find(header.stream);
+        if (it == incomingStreams.end())
+        {
+            if (incomingStreams.size() >= MAX_STREAMS)
+            {
+                return false;
+            }
+            it = incomingStreams.emplace(header.stream, IncomingStream{nextStreamGeneration++}).first;
+        }
+
+        IncomingStream& stream = it->second;
+        const bool ended = header.flags & MessageFlags::STREAM_END;
+        if (stream.ended || header.size > stream.window || header.size > getMaxChunkSize() || (header.size == 0 && !ended))
+        {
+            return false;
+        }
+        stream.window -= header.size;
+        stream.ended = ended;
+        return true;
+    }
+
+    // Opens pending streams while there are free ids and produces chunks of the open ones within their credit
+    void pumpStreams()
+    {
+        std::erase_if(outgoingStreams, [](const auto& entry) { return entry.second.closed && entry.second.queuedChunks == 0; });
+
+        while (!pendingStreams.empty() && outgoingStreams.size() < MAX_STREAMS)
+        {
+            while (outgoingStreams.count(nextStreamId) > 0)
+            {
+                ++nextStreamId;
+            }
+            outgoingStreams.emplace(nextStreamId++, std::move(pendingStreams.front()));
+            pendingStreams.pop_front();
+        }
+
+        for (auto& [streamId, stream] : outgoingStreams)
+        {
+            while (!stream.ended && stream.credit > 0 && stream.queuedChunks < MAX_QUEUED_CHUNKS)
+            {
+                const std::size_t capacity = std::min(getMaxChunkSize(), stream.credit);
+
+                Message chunk;
+                chunk.header.id       = stream.id;
+                chunk.header.priority = stream.priority;
+                chunk.header.flags    = MessageFlags::STREAM_CHUNK;
+                chunk.header.stream   = streamId;
+                chunk.body.resize(capacity);
+                chunk.body.resize(std::min(capacity, stream.producer(chunk.body.data(), capacity)));
+                chunk.header.size = static_cast<uint32_t>(chunk.body.size());
+
+                if (chunk.body.size() < capacity)
+                {
+                    chunk.header.flags |= MessageFlags::STREAM_END;
+                    stream.ended    = true;
+                    stream.producer = nullptr;
+                }
+                stream.credit -= chunk.body.size();
+                ++stream.queuedChunks;
+                qMessagesOut.push(std::move(chunk));
+            }
+        }
+    }
+
+    // The receiver consumed bytes of an outgoing stream. With STREAM_END flag it has closed the stream, so its id can be reused.
+    void onStreamCredit()
+    {
+        uint32_t bytes = 0;
+        std::memcpy(&bytes, tempMsg.body.data(), sizeof(bytes));
+
+        auto it = outgoingStreams.find(tempMsg.header.stream);
+        if (it != outgoingStreams.end())
+        {
+            it->second.credit = std::min(STREAM_WINDOW, it->second.credit + bytes);
+            it->second.closed = tempMsg.isStreamEnd();
+            pumpStreams();
+            startWriting();
+        }
+    }
+
+    // Returns the credit of a consumed chunk. Small amounts are accumulated, a finished stream is closed once all its chunks are consumed.
+    void consumeStream(uint8_t streamId, uint64_t generation, std::size_t bytes)
+    {
+        auto it = incomingStreams.find(streamId);
+        if (it == incomingStreams.end() || it->second.generation != generation)
+        {
+            return;
+        }
+
+        IncomingStream& stream = it->second;
+        stream.unreported += bytes;
+        if (stream.ended && stream.window + stream.unreported == STREAM_WINDOW)
+        {
+            sendStreamCredit(streamId, stream.unreported, true);
+            incomingStreams.erase(it);
+        }
+        else if (!stream.ended && stream.unreported >= STREAM_WINDOW / 4)
+        {
+            sendStreamCredit(streamId, stream.unreported, false);
+            stream.window += stream.unreported;
+            stream.unreported = 0;
+        }
+        startWriting();
+    }
+
+    void sendStreamCredit(uint8_t streamId, std::size_t bytes, bool closeStream)
+    {
+        Message credit;
+        credit.header.id       = MessageType::ServerAcceptRequst;  // is not used by the receiver
+        credit.header.priority = MessagePriority::CONTROL;
+        credit.header.flags    = MessageFlags::STREAM_CREDIT | (closeStream ? MessageFlags::STREAM_END : 0u);
+        credit.header.stream   = streamId;
+        credit << static_cast<uint32_t>(bytes);
+        credit.header.size = sizeof(uint32_t);
+        qMessagesOut.push(std::move(credit));
+    }
+
+    // Is held by a received chunk and all its copies
+    std::shared_ptr<void> makeStreamCredit(uint8_t streamId, uint64_t generation, std::size_t bytes)
+    {
+        return std::shared_ptr<void>(nullptr, [connection = weak_from_this(), streamId, generation, bytes](void*) {
+            if (auto self = connection.lock())
+            {
+                boost::asio::post(self->strand, [connection, streamId, generation, bytes]() {
+                    if (auto self = connection.lock())
+                    {
+                        self->consumeStream(streamId, generation, bytes);
+                    }
+                });
+            }
+        });
+    }
+
+    // Is held by a received message and all its copies
+    std::shared_ptr<void> makeQueuedCredit(std::size_t bytes)
+    {
+        queuedBytes += bytes;
+        return std::shared_ptr<void>(nullptr, [connection = weak_from_this(), bytes](void*) {
+            if (auto self = connection.lock())
+            {
+                boost::asio::post(self->strand, [connection, bytes]() {
+                    if (auto self = connection.lock())
+                    {
+                        self->releaseQueued(bytes);
+                    }
+                });
+            }
+        });
+    }
+
+    bool isReceiveQueueFull() const { return config.maxQueuedBytes > 0 && queuedBytes >= config.maxQueuedBytes; }
+
+    // Messages left in the receive buffer by a full queue are extracted before anything more is read
+    void releaseQueued(std::size_t bytes)
+    {
+        queuedBytes -= bytes;
+        if (readPaused && !isReceiveQueueFull() && socket.is_open())
+        {
+            readPaused = false;
+            if (processReceivedData())
+            {
+                asyncRead();
+            }
+        }
+    }
+
+    void startWriting()
+    {
+        if (established && !writing && !qMessagesOut.empty())
+        {
+            asyncWrite();
+        }
+    }
+
+    // Sends up to MAX_WRITE_BATCH queued messages with a single gathered write. The order of the messages
+    // across priority lanes is decided by qMessagesOut.
+    void asyncWrite()
+    {
+        writing = true;
+
+        writeBuffers.clear();
+        std::size_t batchBytes = 0;
+        while (!qMessagesOut.empty() && writeBatch.size() < MAX_WRITE_BATCH && batchBytes < MAX_WRITE_BATCH_BYTES)
+        {
+            writeBatch.push_back(*qMessagesOut.pop());
+            batchBytes += writeBatch.back().getSize();
+        }
+        for (const Message& msg : writeBatch)
+        {
+            writeBuffers.emplace_back(&msg.header, sizeof(MessageHeader));
+            if (!msg.body.empty())
+            {
+                writeBuffers.emplace_back(msg.body.data(), msg.body.size());
+            }
+        }
+
+        auto self = shared_from_this();
+        boost::asio::async_write(socket, writeBuffers,
+                                 boost::asio::bind_executor(strand, [this, self](std::error_code ec, std::size_t) {
+                                     for (const Message& msg : writeBatch)
                                      {
-                                         qMessagesOut.pop_front();
-                                         if (!qMessagesOut.empty())
+                                         auto it = msg.isStreamChunk() ? outgoingStreams.find(msg.header.stream) : outgoingStreams.end();
+                                         if (it != outgoingStreams.end())
                                          {
-                                             asyncWriteHeader();
+                                             --it->second.queuedChunks;
                                          }
                                      }
+                                     writeBatch.clear();
+                                     writing = false;
+
+                                     if (!ec)
+                                     {
+                                         pumpStreams();
+                                         startWriting();
+                                     }
                                      else
                                      {
-                                         std::cerr << "[" << id << "]"
-                                                   << " Write Body Fail\n";
-                                         socket.close();
+                                         close(ec);
                                      }
-                                 });
+                                 }));
     }
 
     void addToIncomingMessageQueue()
     {
+        if (tempMsg.header.flags & MessageFlags::STREAM_CREDIT)
+        {
+            onStreamCredit();
+            tempMsg = Message();
+            return;
+        }
+
+        if (tempMsg.isStreamChunk())
+        {
+            tempMsg.receiveCredit =
+                makeStreamCredit(tempMsg.header.stream, incomingStreams.at(tempMsg.header.stream).generation, tempMsg.body.size());
+        }
+        else if (config.maxQueuedBytes > 0)
+        {
+            tempMsg.receiveCredit = makeQueuedCredit(tempMsg.getSize() + QUEUED_MESSAGE_OVERHEAD);
+        }
+
         if (owner == OwnerType::SERVER)
         {
             tempMsg.remote = this->shared_from_this();
-            qMessagesIn.push_back(tempMsg);
+            qMessagesIn.push_back(std::move(tempMsg));
         }
         else
         {
-            qMessagesIn.push_back(tempMsg);
+            qMessagesIn.push_back(std::move(tempMsg));
         }
 
-        asyncReadHeader();
+        tempMsg = Message();
     }
 
 protected:
     boost::asio::io_service& service;
-    boost::asio::ip::tcp::socket socket;
 
-    // It holds all messages to be sentto the remote side of this connection
-    SafeQueue<Message> qMessagesOut;
+    // Serializes the handlers of this connection when the service is run by several threads.
+    // Every handler holds a reference to the connection, so it outlives its pending operations.
+    boost::asio::strand<boost::asio::io_service::executor_type> strand;
+
+    Socket socket;
+
+    // It holds all messages to be sentto the remote side of this connection, one lane per priority
+    OutboundQueue qMessagesOut;
+
+    // Messages which are being written at the moment and buffers pointing into them
+    std::vector<Message> writeBatch;
+    std::vector<boost::asio::const_buffer> writeBuffers;
 
     // It holds all messages that have been recieved from the remote side of this connection.
     // This queue is owned by server or a client and expected to be provided by the server either client.
     SafeQueue<Message>& qMessagesIn;
 
+    // Raw bytes read from the socket. [0, readEnd) holds the beginning of a header which is not complete yet.
+    ReceiveBuffer receiveBuffer;
+    std::size_t readEnd = 0;
+
     // Buffer to store the part of incoming message while it is read
     Message tempMsg;
+    bool headerReceived      = false;
+    std::size_t bodyReceived = 0;
+
+    ConnectionConfig config;
+
+    struct OutgoingStream
+    {
+        MessageType id;
+        MessagePriority priority;
+        StreamProducer producer;
+        std::size_t credit       = STREAM_WINDOW;
+        std::size_t queuedChunks = 0;
+        bool ended               = false;  // the last chunk is queued
+        bool closed              = false;  // the receiver has consumed the whole stream
+    };
+
+    struct IncomingStream
+    {
+        uint64_t generation;                // tells the credit of a finished stream from the one of a new stream with the same id
+        std::size_t window     = STREAM_WINDOW;  // bytes the sender may send before it gets more credit
+        std::size_t unreported = 0;              // consumed bytes not credited yet
+        bool ended             = false;
+    };
+
+    std::deque<OutgoingStream> pendingStreams;  // wait for a free stream id
+    std::map<uint8_t, OutgoingStream> outgoingStreams;
+    uint8_t nextStreamId = 0;
+
+    std::map<uint8_t, IncomingStream> incomingStreams;
+    uint64_t nextStreamGeneration = 0;
+
+    CloseHandler onClose;
+
+    // Bytes of received messages which are not released by the owner yet
+    std::size_t queuedBytes = 0;
+    bool readPaused         = false;
 
-    OwnerType owner = OwnerType::SERVER;
-    uint32_t id     = 0;
+    OwnerType owner  = OwnerType::SERVER;
+    uint32_t id      = 0;
+    bool established = false;
+    bool writing     = false;
 };
 
 }  // namespace Network
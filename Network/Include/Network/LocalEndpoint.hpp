@@ -0,0 +1,86 @@
+#pragma once
+#include "Common.hpp"
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+
+namespace Network
+{
+
+// Directory of the Unix domain sockets, which only the current user may write to: $XDG_RUNTIME_DIR or, without it,
+// a 0700 directory of the user in the temp directory. In a world-writable directory another user could take the socket
+// path first and receive the clients. Returns an empty path if the directory is not private.
+inline std::filesystem::path getLocalSocketDirectory()
+{
+#ifdef _WIN32
+    return {};
+#else
+    std::filesystem::path directory;
+    if (const char* runtimeDirectory = std::getenv("XDG_RUNTIME_DIR"); runtimeDirectory && *runtimeDirectory)
+    {
+        directory = runtimeDirectory;
+    }
+    else
+    {
+        std::error_code ec;
+        const std::filesystem::path tempDirectory = std::filesystem::temp_directory_path(ec);
+        if (ec)
+        {
+            return {};
+        }
+        directory = tempDirectory / ("asio-training-" + std::to_string(geteuid()));
+        mkdir(directory.c_str(), 0700);
+    }
+
+    // The directory itself must not be a link or belong to someone else
+    struct stat st;
+    if (lstat(directory.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & 077) != 0)
+    {
+        return {};
+    }
+    return directory;
+#endif
+}
+
+// Whether the path fits into the address of a Unix domain socket, which is about a hundred bytes long
+inline bool isValidLocalSocketPath(const std::string& path)
+{
+#ifdef _WIN32
+    return false;
+#else
+    return !path.empty() && path.size() < sizeof(sockaddr_un::sun_path);
+#endif
+}
+
+// Path of the Unix domain socket the server listens on next to its TCP port, empty if there is no private directory
+// or the path is too long for a socket address. Clients on the same host derive it from the port to skip the TCP loopback stack.
+inline std::string getLocalSocketPath(uint16_t port)
+{
+    const std::filesystem::path directory = getLocalSocketDirectory();
+    if (directory.empty())
+    {
+        return {};
+    }
+    const std::string path = (directory / ("asio-training-" + std::to_string(port) + ".sock")).string();
+    return isValidLocalSocketPath(path) ? path : std::string();
+}
+
+// Whether the path is a socket created by the current user, so it is served by our server
+inline bool isOwnLocalSocket(const std::string& path)
+{
+#ifdef _WIN32
+    return false;
+#else
+    struct stat st;
+    return isValidLocalSocketPath(path) && lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode) && st.st_uid == geteuid();
+#endif
+}
+
+}  // namespace Network
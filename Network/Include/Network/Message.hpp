@@ -1,9 +1,13 @@
+#pragma once
+#include <memory>
 #include <ostream>
 
 #include "Common.hpp"
 
 namespace Network
 {
+class Connection;
+
 enum class MessageType : std::uint8_t
 {
     ServerAcceptRequst,
@@ -12,20 +16,70 @@ enum class MessageType : std::uint8_t
     LoginRequest,
     LoginAnswer,
 
+    RegistrationRequest,
+    RegistrationAnswer,
+
+    MessageStoreRequest,
+    MessageStoreAnswer,
+
+    SubscribeRequest,
+    SubscribeAnswer,
+
+    UnsubscribeRequest,
+    UnsubscribeAnswer,
+
+    PublishRequest,
+    PublishAnswer,
+
+    TopicMessage,  // a published message delivered to a subscriber of its topic
+};
+
+// Outbound lane of a message. Lanes with lower values are served more often, see OutboundQueue.
+enum class MessagePriority : std::uint8_t
+{
+    CONTROL,  // small replies the remote side is waiting for: accept, login, acknowledgements
+    NORMAL,
+    BULK,  // large transfers which may be delayed in favour of the other lanes
+};
+
+constexpr std::size_t MESSAGE_PRIORITIES_COUNT = 3;
+
+// Bits of MessageHeader::flags. They are set by Connection, which splits large payloads into streams of chunks.
+struct MessageFlags
+{
+    static constexpr uint8_t STREAM_CHUNK  = 1u << 0;  // body is the next part of the stream header.stream
+    static constexpr uint8_t STREAM_END    = 1u << 1;  // the last chunk of the stream, or the stream is closed with a credit
+    static constexpr uint8_t STREAM_CREDIT = 1u << 2;  // body is uint32_t amount of bytes of the stream consumed by the receiver
 };
 
 struct MessageHeader
 {
     MessageType id;
+    MessagePriority priority = MessagePriority::NORMAL;
+    uint8_t flags            = 0u;
+    uint8_t stream           = 0u;  // priority, flags and stream occupy the former padding, the header stays 8 bytes
     uint32_t size = 0u;  // std::size_t size = 0u; // TODO: Investigate if std::size_t is the same on x32 and x64 systems
 };
 
+static_assert(sizeof(MessageHeader) == 8, "MessageHeader layout is a part of the protocol");
+
 class Message
 {
 public:
     MessageHeader header;
     std::vector<uint8_t> body;
 
+    // Connection the message has been received from. It is set on the server side only.
+    std::shared_ptr<Connection> remote = nullptr;
+
+    // Set on received messages and released with the last copy of the message. The bytes of a stream chunk are credited
+    // back to the sender of the stream then, the bytes of another message leave the receive budget of the connection.
+    // So holding received messages slows the sender down.
+    std::shared_ptr<void> receiveCredit = nullptr;
+
+    bool isStreamChunk() const { return header.flags & MessageFlags::STREAM_CHUNK; }
+    bool isStreamEnd() const { return header.flags & MessageFlags::STREAM_END; }
+
     // returns size of the whole message packet in bytes
     size_t getSize() const { return sizeof(MessageHeader) + body.size(); }
 
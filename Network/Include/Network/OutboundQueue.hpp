@@ -0,0 +1,91 @@
+#pragma once
+#include <array>
+#include <optional>
+
+#include "Common.hpp"
+#include "Message.hpp"
+
+namespace Network
+{
+
+// Outbound messages of a connection split into lanes by priority.
+//
+// Lanes are served by deficit round robin: on every visit a lane earns WEIGHTS[lane] * QUANTUM bytes of credit
+// and sends messages while the credit covers them. Control replies therefore overtake queued bulk data, while
+// lower lanes still get their share of the bandwidth and cannot starve.
+// It is not thread-safe: a connection uses it on its strand only.
+class OutboundQueue
+{
+public:
+    static constexpr std::size_t QUANTUM = 16u * 1024u;
+    static constexpr std::array<std::size_t, MESSAGE_PRIORITIES_COUNT> WEIGHTS{8, 4, 1};
+
+    void push(Message&& msg)
+    {
+        lanes[laneOf(msg)].push_back(std::move(msg));
+        ++count;
+    }
+
+    bool empty() const { return count == 0; }
+
+    std::size_t size() const { return count; }
+
+    // Returns the next message to be sent
+    std::optional<Message> pop()
+    {
+        if (count == 0)
+        {
+            return std::nullopt;
+        }
+
+        while (true)
+        {
+            auto& lane = lanes[currentLane];
+            if (lane.empty())
+            {
+                deficits[currentLane] = 0;
+                nextLane();
+                continue;
+            }
+
+            if (!quantumGranted)
+            {
+                deficits[currentLane] += WEIGHTS[currentLane] * QUANTUM;
+                quantumGranted = true;
+            }
+
+            const std::size_t messageSize = lane.front().getSize();
+            if (messageSize <= deficits[currentLane])
+            {
+                deficits[currentLane] -= messageSize;
+                Message msg = std::move(lane.front());
+                lane.pop_front();
+                --count;
+                return msg;
+            }
+
+            nextLane();
+        }
+    }
+
+private:
+    // Priority comes from the remote side too, so unknown values go to the lowest lane
+    static std::size_t laneOf(const Message& msg)
+    {
+        return std::min(static_cast<std::size_t>(msg.header.priority), MESSAGE_PRIORITIES_COUNT - 1);
+    }
+
+    void nextLane()
+    {
+        currentLane    = (currentLane + 1) % MESSAGE_PRIORITIES_COUNT;
+        quantumGranted = false;
+    }
+
+    std::array<std::deque<Message>, MESSAGE_PRIORITIES_COUNT> lanes;
+    std::array<std::size_t, MESSAGE_PRIORITIES_COUNT> deficits{};
+    std::size_t currentLane = 0;
+    bool quantumGranted     = false;
+    std::size_t count       = 0;
+};
+
+}  // namespace Network
@@ -0,0 +1,214 @@
+#pragma once
+#include "Common.hpp"
+
+#include <boost/asio.hpp>
+#include <optional>
+
+#ifdef BOOST_ASIO_HAS_IO_URING
+#include <sys/resource.h>
+
+// The io_uring backend and registered buffers came with Asio 1.21. An older Asio would only be caught by
+// missing names, or not at all if it takes the macro and builds the epoll reactor anyway.
+#if BOOST_ASIO_VERSION < 102100
+#error "USE_IO_URING requires Boost.Asio 1.21 (Boost 1.78) or newer"
+#endif
+#endif
+
+namespace Network
+{
+
+class ReceiveBufferPool;
+
+// Receive buffer of a connection. It is either a slot of ReceiveBufferPool or, when the pool is exhausted
+// or not provided, a standalone heap buffer.
+class ReceiveBuffer
+{
+public:
+    ReceiveBuffer() = default;
+    explicit ReceiveBuffer(std::size_t size) : storage(std::make_unique_for_overwrite<uint8_t[]>(size)), ptr(storage.get()), bufferSize(size) {}
+
+    ReceiveBuffer(ReceiveBuffer&& other) noexcept { *this = std::move(other); }
+    ReceiveBuffer& operator=(ReceiveBuffer&& other) noexcept;
+
+    ~ReceiveBuffer() { release(); }
+
+    uint8_t* data() const { return ptr; }
+    std::size_t size() const { return bufferSize; }
+
+    // Reads into [offset, size()). With io_uring the read of a pool slot is issued as a fixed buffer operation.
+    template <class Stream, class Handler>
+    void asyncReadSome(Stream& stream, std::size_t offset, Handler&& handler)
+    {
+#ifdef BOOST_ASIO_HAS_IO_URING
+        if (registered)
+        {
+            stream.async_read_some(boost::asio::buffer(*registered + offset, bufferSize - offset), std::forward<Handler>(handler));
+            return;
+        }
+#endif
+        stream.async_read_some(boost::asio::buffer(ptr + offset, bufferSize - offset), std::forward<Handler>(handler));
+    }
+
+private:
+    friend class ReceiveBufferPool;
+
+    void release();
+
+    ReceiveBufferPool* pool = nullptr;
+    std::size_t slot        = 0;
+    std::unique_ptr<uint8_t[]> storage;
+    uint8_t* ptr           = nullptr;
+    std::size_t bufferSize = 0;
+#ifdef BOOST_ASIO_HAS_IO_URING
+    std::optional<boost::asio::mutable_registered_buffer> registered;
+#endif
+};
+
+// Fixed set of equally sized receive buffers carved out of one allocation.
+// With the io_uring backend the slots are registered in the io_context, so the kernel does not have to
+// map the pages of a buffer on every read. Registered buffers are pinned and count against RLIMIT_MEMLOCK,
+// so only as many slots as fit into half of it are registered and the rest is read as usual.
+// The pool must outlive the connections which use its buffers.
+class ReceiveBufferPool
+{
+public:
+    static constexpr std::size_t DEFAULT_SLOTS_COUNT = 1024;
+    static constexpr std::size_t DEFAULT_SLOT_SIZE   = 64u * 1024u;
+
+    ReceiveBufferPool([[maybe_unused]] boost::asio::io_service& service, std::size_t slotsCount = DEFAULT_SLOTS_COUNT,
+                      std::size_t slotSize = DEFAULT_SLOT_SIZE)
+        : storage(std::make_unique_for_overwrite<uint8_t[]>(slotsCount * slotSize)), slotSize(slotSize)
+    {
+        freeSlots.reserve(slotsCount);
+        for (std::size_t i = slotsCount; i > 0; --i)
+        {
+            freeSlots.push_back(i - 1);
+        }
+
+#ifdef BOOST_ASIO_HAS_IO_URING
+        std::vector<boost::asio::mutable_buffer> slots;
+        const std::size_t registeredCount = getRegistrableSlotsCount(slotsCount, slotSize);
+        slots.reserve(registeredCount);
+        for (std::size_t i = 0; i < registeredCount; ++i)
+        {
+            slots.emplace_back(storage.get() + i * slotSize, slotSize);
+        }
+
+        try
+        {
+            if (!slots.empty())
+            {
+                registration.emplace(boost::asio::register_buffers(service, slots));
+            }
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "[ReceiveBufferPool] Buffers are not registered: " << e.what() << '\n';
+        }
+#endif
+    }
+
+    ReceiveBufferPool(const ReceiveBufferPool&) = delete;
+
+    // Returns a free slot or a heap buffer of the same size if all the slots are taken
+    ReceiveBuffer acquire()
+    {
+        std::scoped_lock lock(mtxSlots);
+        if (freeSlots.empty())
+        {
+            return ReceiveBuffer(slotSize);
+        }
+
+        ReceiveBuffer buffer;
+        buffer.pool       = this;
+        buffer.slot       = freeSlots.back();
+        buffer.ptr        = storage.get() + buffer.slot * slotSize;
+        buffer.bufferSize = slotSize;
+#ifdef BOOST_ASIO_HAS_IO_URING
+        if (buffer.slot < getRegisteredSlotsCount())
+        {
+            buffer.registered = (*registration)[buffer.slot];
+        }
+#endif
+        freeSlots.pop_back();
+        return buffer;
+    }
+
+    std::size_t getSlotSize() const { return slotSize; }
+
+    // Slots read as fixed buffers: the ones with the lowest numbers, which are handed out first by a new pool
+    std::size_t getRegisteredSlotsCount() const
+    {
+#ifdef BOOST_ASIO_HAS_IO_URING
+        return registration ? registration->size() : 0;
+#else
+        return 0;
+#endif
+    }
+
+    std::size_t getFreeSlotsCount() const
+    {
+        std::scoped_lock lock(mtxSlots);
+        return freeSlots.size();
+    }
+
+private:
+    friend class ReceiveBuffer;
+
+#ifdef BOOST_ASIO_HAS_IO_URING
+    // The other half of the limit is left for the rings and other locked memory of the process
+    static std::size_t getRegistrableSlotsCount(std::size_t slotsCount, std::size_t slotSize)
+    {
+        rlimit limit;
+        if (getrlimit(RLIMIT_MEMLOCK, &limit) != 0 || limit.rlim_cur == RLIM_INFINITY)
+        {
+            return slotsCount;
+        }
+        return std::min(slotsCount, static_cast<std::size_t>(limit.rlim_cur / 2) / slotSize);
+    }
+#endif
+
+    void release(std::size_t slot)
+    {
+        std::scoped_lock lock(mtxSlots);
+        freeSlots.push_back(slot);
+    }
+
+    std::unique_ptr<uint8_t[]> storage;
+    std::size_t slotSize;
+
+    mutable std::mutex mtxSlots;
+    std::vector<std::size_t> freeSlots;
+
+#ifdef BOOST_ASIO_HAS_IO_URING
+    std::optional<boost::asio::buffer_registration<std::vector<boost::asio::mutable_buffer>>> registration;
+#endif
+};
+
+inline ReceiveBuffer& ReceiveBuffer::operator=(ReceiveBuffer&& other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        pool       = std::exchange(other.pool, nullptr);
+        slot       = other.slot;
+        storage    = std::move(other.storage);
+        ptr        = std::exchange(other.ptr, nullptr);
+        bufferSize = std::exchange(other.bufferSize, 0);
+#ifdef BOOST_ASIO_HAS_IO_URING
+        registered = std::exchange(other.registered, std::nullopt);
+#endif
+    }
+    return *this;
+}
+
+inline void ReceiveBuffer::release()
+{
+    if (pool)
+    {
+        pool->release(slot);
+        pool = nullptr;
+    }
+}
+
+}  // namespace Network
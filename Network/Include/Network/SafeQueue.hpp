@@ -26,14 +26,29 @@ public:
 
     void push_back(const T& item)
     {
-        std::scoped_lock lock(mtxQue);
-        que.emplace_back(std::move(item));
+        {
+            std::scoped_lock lock(mtxQue);
+            que.emplace_back(item);
+        }
+        notify();
+    }
+
+    void push_back(T&& item)
+    {
+        {
+            std::scoped_lock lock(mtxQue);
+            que.emplace_back(std::move(item));
+        }
+        notify();
     }
 
     void push_front(const T& item)
     {
-        std::scoped_lock lock(mtxQue);
-        que.emplace_front(std::move(item));
+        {
+            std::scoped_lock lock(mtxQue);
+            que.emplace_front(item);
+        }
+        notify();
     }
 
     bool empty() const
@@ -72,14 +87,18 @@ public:
 
     void wait()
     {
-        while (empty())
-        {
-            std::unique_lock<std::mutex> uniqueLock(uniqueMtx);
-            mBlock.wait(uniqueLock);
-        }
+        std::unique_lock<std::mutex> uniqueLock(uniqueMtx);
+        mBlock.wait(uniqueLock, [this]() { return !empty(); });
     }
 
 protected:
+    // Taking uniqueMtx guarantees that a waiter is either before its emptiness check or already blocked
+    void notify()
+    {
+        std::unique_lock<std::mutex> uniqueLock(uniqueMtx);
+        mBlock.notify_one();
+    }
+
     mutable std::mutex mtxQue, uniqueMtx;  // TODO: Investigate lock-free queue instead
     std::condition_variable mBlock;
     std::deque<T> que;
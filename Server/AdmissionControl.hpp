@@ -0,0 +1,139 @@
+#pragma once
+#include <Network/Common.hpp>
+#include <boost/asio.hpp>
+#include <map>
+#include <optional>
+
+// Limits for new connections of the Server
+struct AdmissionConfig
+{
+    std::size_t maxConnections           = 50000;
+    std::size_t maxConnectionsPerAddress = 256;
+
+    // Token bucket of new connections: refilled with acceptRate tokens per second up to acceptBurst tokens
+    double acceptRate       = 5000.0;
+    std::size_t acceptBurst = 1000;
+
+    // Amount of async_accept operations kept outstanding on every acceptor
+    std::size_t pendingAccepts = 16;
+};
+
+struct AdmissionStats
+{
+    uint64_t admitted             = 0;
+    uint64_t rejectedByLimit      = 0;  // global connection cap
+    uint64_t rejectedByAddress    = 0;  // per source address cap
+    uint64_t rejectedByRate       = 0;  // token bucket is empty
+    uint64_t acceptErrors         = 0;
+    uint64_t closedConnections    = 0;
+    uint64_t closedOnError        = 0;  // of them: failed reads or writes other than the end of stream, and rejected frames
+    std::size_t activeConnections = 0;
+};
+
+// Decides whether an accepted socket becomes a connection. It is consulted before anything is allocated for the
+// socket, so an overloaded server rejects quickly instead of degrading all the connections it already has.
+class AdmissionController
+{
+public:
+    enum class Decision : uint8_t
+    {
+        ADMIT,
+        REJECT_LIMIT,
+        REJECT_ADDRESS,
+        REJECT_RATE,
+    };
+
+    explicit AdmissionController(AdmissionConfig cfg = {})
+        : config(std::move(cfg)), tokens(static_cast<double>(config.acceptBurst)), lastRefill(std::chrono::steady_clock::now())
+    {
+    }
+
+    // Address is absent for Unix domain sockets, which are not limited per source
+    Decision tryAdmit(const std::optional<boost::asio::ip::address>& address)
+    {
+        std::scoped_lock lock(mtx);
+
+        if (stats.activeConnections >= config.maxConnections)
+        {
+            ++stats.rejectedByLimit;
+            return Decision::REJECT_LIMIT;
+        }
+
+        if (address && connectionsPerAddress[*address] >= config.maxConnectionsPerAddress)
+        {
+            ++stats.rejectedByAddress;
+            return Decision::REJECT_ADDRESS;
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        tokens         = std::min(static_cast<double>(config.acceptBurst),
+                                  tokens + std::chrono::duration<double>(now - lastRefill).count() * config.acceptRate);
+        lastRefill     = now;
+        if (tokens < 1.0)
+        {
+            ++stats.rejectedByRate;
+            return Decision::REJECT_RATE;
+        }
+        tokens -= 1.0;
+
+        if (address)
+        {
+            ++connectionsPerAddress[*address];
+        }
+        ++stats.activeConnections;
+        ++stats.admitted;
+        return Decision::ADMIT;
+    }
+
+    // Must be called once for every admitted connection when it is closed
+    void release(const std::optional<boost::asio::ip::address>& address)
+    {
+        std::scoped_lock lock(mtx);
+
+        if (address)
+        {
+            auto it = connectionsPerAddress.find(*address);
+            if (it != connectionsPerAddress.end() && --it->second == 0)
+            {
+                connectionsPerAddress.erase(it);
+            }
+        }
+        --stats.activeConnections;
+    }
+
+    // Is called for every closed connection with the reason given by Network::Connection
+    void onClose(const std::error_code& reason)
+    {
+        static const std::error_code endOfStream = boost::system::error_code(boost::asio::error::eof);
+
+        std::scoped_lock lock(mtx);
+        ++stats.closedConnections;
+        if (reason && reason != endOfStream)
+        {
+            ++stats.closedOnError;
+        }
+    }
+
+    void onAcceptError()
+    {
+        std::scoped_lock lock(mtx);
+        ++stats.acceptErrors;
+    }
+
+    AdmissionStats getStats() const
+    {
+        std::scoped_lock lock(mtx);
+        return stats;
+    }
+
+    const AdmissionConfig& getConfig() const { return config; }
+
+private:
+    AdmissionConfig config;
+
+    mutable std::mutex mtx;
+    std::map<boost::asio::ip::address, std::size_t> connectionsPerAddress;
+    double tokens;
+    std::chrono::steady_clock::time_point lastRefill;
+    AdmissionStats stats;
+};
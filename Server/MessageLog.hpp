@@ -0,0 +1,812 @@
+#pragma once
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <Network/Common.hpp>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
+
+// Settings of the on-disk message log
+struct MessageLogConfig
+{
+    std::filesystem::path directory = "MessageStore";
+
+    // Size of a single segment file. A record must fit into one segment.
+    std::size_t segmentSize = 64u * 1024u * 1024u;
+
+    // How long the commit thread lingers for more writers before fdatasync is called. Even without lingering
+    // all the records written while the previous fdatasync was running are committed together.
+    std::chrono::microseconds commitInterval{0};
+
+    // Amount of uncommitted bytes which forces a commit without waiting for commitInterval
+    std::size_t commitBatchBytes = 1024u * 1024u;
+
+    // Sealed segments with a larger share of expired bytes are rewritten by compact()
+    double compactionDeadRatio = 0.5;
+};
+
+struct StoredMessage
+{
+    uint64_t sequence  = 0;
+    uint64_t timestamp = 0;
+    uint32_t userId    = 0;
+    std::vector<uint8_t> body;
+};
+
+// Append-only message log split into memory-mapped segment files (POSIX only).
+//
+// Records are copied into the mapping of the active segment by append() and made durable by a single commit
+// thread which calls fdatasync for all the records written since the previous commit (group commit). On Linux
+// the pages of a shared mapping live in the page cache of the file, so fdatasync flushes them as well.
+// Every record is protected by a checksum, so a torn tail left by a crash is detected and dropped on startup.
+// A failed fdatasync leaves the log failed: the state of the written pages is unknown then, so nothing is made durable
+// after it and append(), waitDurable() and sync() throw the error.
+class MessageLog
+{
+public:
+    explicit MessageLog(MessageLogConfig cfg = {}) : config(std::move(cfg))
+    {
+        std::filesystem::create_directories(config.directory);
+        recover();
+        commitThread = std::thread([this]() { commitLoop(); });
+    }
+
+    MessageLog(const MessageLog&)            = delete;
+    MessageLog& operator=(const MessageLog&) = delete;
+
+    virtual ~MessageLog()
+    {
+        {
+            std::scoped_lock lock(mtxCommit);
+            stopping = true;
+        }
+        cvCommit.notify_all();
+
+        if (commitThread.joinable())
+        {
+            commitThread.join();
+        }
+    }
+
+    // Writes the record into the active segment and returns its sequence number.
+    // The record is visible to readers at once but durable only after waitDurable(sequence) returns.
+    uint64_t append(uint32_t userId, uint64_t timestamp, const uint8_t* data, std::size_t size)
+    {
+        const std::size_t recordSize = alignRecord(sizeof(RecordHeader) + size);
+        if (recordSize > config.segmentSize || size > std::numeric_limits<uint32_t>::max())
+        {
+            throw std::length_error("MessageLog: record does not fit into a segment");
+        }
+
+        std::unique_lock lock(mtx);
+        {
+            std::scoped_lock commitLock(mtxCommit);
+            throwIfFailed();
+        }
+        if (activeSegment->size + recordSize > activeSegment->capacity)
+        {
+            rotate();
+        }
+
+        RecordHeader header;
+        header.sequence  = nextSequence++;
+        header.timestamp = timestamp;
+        header.userId    = userId;
+        header.size      = static_cast<uint32_t>(size);
+        header.checksum  = checksum(header, data);
+
+        const std::size_t offset = activeSegment->size;
+        std::memcpy(activeSegment->data + offset, &header, sizeof(RecordHeader));
+        std::memcpy(activeSegment->data + offset + sizeof(RecordHeader), data, size);
+        activeSegment->size += recordSize;
+
+        addToIndex(header, activeSegment.get(), offset);
+
+        bool commitNow = false;
+        {
+            std::scoped_lock commitLock(mtxCommit);
+            writtenSequence = header.sequence;
+            pendingBytes += recordSize;
+            commitNow = pendingBytes >= config.commitBatchBytes;
+        }
+        commitNow ? cvCommit.notify_all() : cvCommit.notify_one();
+
+        return header.sequence;
+    }
+
+    uint64_t append(uint32_t userId, uint64_t timestamp, const std::vector<uint8_t>& body)
+    {
+        return append(userId, timestamp, body.data(), body.size());
+    }
+
+    // Blocks until the record with the given sequence number is on disk, throws if the commit has failed
+    void waitDurable(uint64_t sequence)
+    {
+        std::unique_lock lock(mtxCommit);
+        cvDurable.wait(lock, [this, sequence]() { return durableSequence >= sequence || commitError; });
+        if (durableSequence < sequence)
+        {
+            throwIfFailed();
+        }
+    }
+
+    uint64_t appendDurable(uint32_t userId, uint64_t timestamp, const uint8_t* data, std::size_t size)
+    {
+        const uint64_t sequence = append(userId, timestamp, data, size);
+        waitDurable(sequence);
+        return sequence;
+    }
+
+    // Is called with an empty error once the record is on disk, or with the error of the failed commit
+    using DurableCallback = std::function<void(const std::error_code&)>;
+
+    // Calls the callback from the commit thread when the commit covering the sequence number completes, so the caller
+    // is not blocked. It is called at once by the calling thread if the record is already durable or the log has failed.
+    void onDurable(uint64_t sequence, DurableCallback callback)
+    {
+        std::error_code error;
+        {
+            std::scoped_lock lock(mtxCommit);
+            if (durableSequence < sequence && !commitError)
+            {
+                durableCallbacks.emplace(sequence, std::move(callback));
+                return;
+            }
+            if (durableSequence < sequence)
+            {
+                error = commitError;
+            }
+        }
+        callback(error);
+    }
+
+    // Commits everything written so far without waiting for the commit interval
+    void sync()
+    {
+        uint64_t sequence = 0;
+        {
+            std::scoped_lock lock(mtxCommit);
+            sequence      = writtenSequence;
+            syncRequested = true;
+        }
+        cvCommit.notify_all();
+        waitDurable(sequence);
+    }
+
+    // Returns messages of the user with timestamps in [fromTimestamp, toTimestamp] ordered by timestamp
+    std::vector<StoredMessage> readHistory(uint32_t userId, uint64_t fromTimestamp = 0,
+                                           uint64_t toTimestamp = std::numeric_limits<uint64_t>::max(),
+                                           std::size_t limit    = std::numeric_limits<std::size_t>::max()) const
+    {
+        std::vector<StoredMessage> messages;
+
+        std::shared_lock lock(mtx);
+        const auto userIt = index.find(userId);
+        if (userIt == index.end())
+        {
+            return messages;
+        }
+
+        const auto& entries = userIt->second;
+        auto it             = std::lower_bound(entries.begin(), entries.end(), fromTimestamp,
+                                               [](const IndexEntry& entry, uint64_t ts) { return entry.timestamp < ts; });
+
+        for (; it != entries.end() && it->timestamp <= toTimestamp && messages.size() < limit; ++it)
+        {
+            RecordHeader header;
+            std::memcpy(&header, it->segment->data + it->offset, sizeof(RecordHeader));
+
+            StoredMessage& message = messages.emplace_back();
+            message.sequence       = header.sequence;
+            message.timestamp      = header.timestamp;
+            message.userId         = header.userId;
+
+            const uint8_t* body = it->segment->data + it->offset + sizeof(RecordHeader);
+            message.body.assign(body, body + header.size);
+        }
+
+        return messages;
+    }
+
+    // Drops records older than retainFromTimestamp from sealed segments.
+    // Segments without live records are removed, segments with enough expired bytes are rewritten.
+    // The rewrite happens outside of the log lock, so appends and reads are blocked only while segments are swapped.
+    void compact(uint64_t retainFromTimestamp)
+    {
+        std::scoped_lock compactionLock(mtxCompaction);
+
+        std::vector<std::shared_ptr<Segment>> sealed;
+        {
+            std::shared_lock lock(mtx);
+            for (const auto& [base, segment] : segments)
+            {
+                if (segment != activeSegment)
+                {
+                    sealed.push_back(segment);
+                }
+            }
+        }
+
+        std::map<uint64_t, std::shared_ptr<Segment>> replacements;  // nullptr means that the segment is removed
+        for (const auto& segment : sealed)
+        {
+            std::size_t liveBytes = 0;
+            forEachRecord(*segment, [&](const RecordHeader& header, std::size_t, std::size_t recordSize) {
+                if (header.timestamp >= retainFromTimestamp)
+                {
+                    liveBytes += recordSize;
+                }
+            });
+
+            if (liveBytes == 0)
+            {
+                replacements.emplace(segment->baseSequence, nullptr);
+            }
+            else if (static_cast<double>(segment->size - liveBytes) >= config.compactionDeadRatio * static_cast<double>(segment->size))
+            {
+                replacements.emplace(segment->baseSequence, rewriteSegment(*segment, liveBytes, retainFromTimestamp));
+            }
+        }
+
+        if (replacements.empty())
+        {
+            return;
+        }
+
+        std::vector<std::shared_ptr<Segment>> retired;
+        {
+            std::unique_lock lock(mtx);
+
+            std::unordered_set<const Segment*> replaced;
+            for (const auto& [base, replacement] : replacements)
+            {
+                auto it = segments.find(base);
+                replaced.insert(it->second.get());
+                retired.push_back(std::move(it->second));
+
+                if (replacement)
+                {
+                    it->second = replacement;
+                }
+                else
+                {
+                    segments.erase(it);
+                }
+            }
+
+            for (auto it = index.begin(); it != index.end();)
+            {
+                std::erase_if(it->second, [&replaced](const IndexEntry& entry) { return replaced.count(entry.segment) > 0; });
+                it = it->second.empty() ? index.erase(it) : std::next(it);
+            }
+
+            for (const auto& [base, replacement] : replacements)
+            {
+                if (replacement)
+                {
+                    forEachRecord(*replacement, [&](const RecordHeader& header, std::size_t offset, std::size_t) {
+                        addToIndex(header, replacement.get(), offset);
+                    });
+                }
+            }
+        }
+
+        for (const auto& segment : retired)
+        {
+            if (!replacements.at(segment->baseSequence))
+            {
+                std::filesystem::remove(segment->path);
+            }
+        }
+        syncDirectory();
+    }
+
+    uint64_t getDurableSequence() const
+    {
+        std::scoped_lock lock(mtxCommit);
+        return durableSequence;
+    }
+
+    uint64_t getNextSequence() const
+    {
+        std::shared_lock lock(mtx);
+        return nextSequence;
+    }
+
+    std::size_t getSegmentsCount() const
+    {
+        std::shared_lock lock(mtx);
+        return segments.size();
+    }
+
+    // Amount of fdatasync calls issued by the commit thread
+    uint64_t getCommitsCount() const { return commitsCount.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr uint32_t RECORD_MAGIC = 0x4D534731u;  // "MSG1"
+
+    struct RecordHeader
+    {
+        uint32_t magic     = RECORD_MAGIC;
+        uint32_t checksum  = 0u;
+        uint64_t sequence  = 0u;
+        uint64_t timestamp = 0u;
+        uint32_t userId    = 0u;
+        uint32_t size      = 0u;  // size of the payload which follows the header
+    };
+
+    struct Segment
+    {
+        uint64_t baseSequence = 0;
+        std::filesystem::path path;
+        int fd               = -1;
+        uint8_t* data        = nullptr;
+        std::size_t capacity = 0;  // mapped bytes
+        std::size_t size     = 0;  // bytes occupied by records
+
+        ~Segment()
+        {
+            if (data)
+            {
+                munmap(data, capacity);
+            }
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+        }
+    };
+
+    struct IndexEntry
+    {
+        uint64_t timestamp;
+        const Segment* segment;
+        std::size_t offset;
+    };
+
+    static std::size_t alignRecord(std::size_t size) { return (size + 7u) & ~std::size_t{7u}; }
+
+    [[noreturn]] static void throwSystemError(const std::string& what)
+    {
+        throw std::system_error(errno, std::generic_category(), "MessageLog: " + what);
+    }
+
+    // Must be called under mtxCommit
+    void throwIfFailed() const
+    {
+        if (commitError)
+        {
+            throw std::system_error(commitError, "MessageLog: commit failed");
+        }
+    }
+
+    static uint32_t crc32(uint32_t crc, const uint8_t* data, std::size_t size)
+    {
+        static constexpr auto table = []() {
+            std::array<uint32_t, 256> t{};
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k)
+                {
+                    c = (c & 1u) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                t[i] = c;
+            }
+            return t;
+        }();
+
+        crc = ~crc;
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            crc = table[(crc ^ data[i]) & 0xFFu] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    // Covers everything after the checksum field and the payload
+    static uint32_t checksum(const RecordHeader& header, const uint8_t* body)
+    {
+        const auto* fields = reinterpret_cast<const uint8_t*>(&header) + offsetof(RecordHeader, sequence);
+        const uint32_t crc = crc32(0u, fields, sizeof(RecordHeader) - offsetof(RecordHeader, sequence));
+        return crc32(crc, body, header.size);
+    }
+
+    // Calls fn(header, offset, recordSize) for every valid record of the segment.
+    // Returns the offset right after the last valid record.
+    template <class Fn>
+    static std::size_t forEachRecord(const Segment& segment, Fn&& fn)
+    {
+        std::size_t offset    = 0;
+        uint64_t lastSequence = 0;
+        while (offset + sizeof(RecordHeader) <= segment.capacity)
+        {
+            RecordHeader header;
+            std::memcpy(&header, segment.data + offset, sizeof(RecordHeader));
+
+            const std::size_t recordSize = alignRecord(sizeof(RecordHeader) + header.size);
+            if (header.magic != RECORD_MAGIC || header.sequence <= lastSequence || recordSize > segment.capacity - offset ||
+                header.checksum != checksum(header, segment.data + offset + sizeof(RecordHeader)))
+            {
+                break;
+            }
+
+            fn(header, offset, recordSize);
+            lastSequence = header.sequence;
+            offset += recordSize;
+        }
+        return offset;
+    }
+
+    std::filesystem::path segmentPath(uint64_t baseSequence) const
+    {
+        std::ostringstream name;
+        name << "segment-" << std::setw(20) << std::setfill('0') << baseSequence << ".log";
+        return config.directory / name.str();
+    }
+
+    void syncDirectory() const
+    {
+        const int dirFd = open(config.directory.c_str(), O_RDONLY | O_DIRECTORY);
+        if (dirFd >= 0)
+        {
+            fsync(dirFd);
+            close(dirFd);
+        }
+    }
+
+    static void mapSegment(Segment& segment, std::size_t length, bool writable)
+    {
+        if (segment.data)
+        {
+            munmap(segment.data, segment.capacity);
+            segment.data     = nullptr;
+            segment.capacity = 0;
+        }
+
+        const int protection = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+        void* data           = mmap(nullptr, length, protection, MAP_SHARED, segment.fd, 0);
+        if (data == MAP_FAILED)
+        {
+            throwSystemError("mmap " + segment.path.string());
+        }
+
+        segment.data     = static_cast<uint8_t*>(data);
+        segment.capacity = length;
+    }
+
+    std::shared_ptr<Segment> openSegment(const std::filesystem::path& path, uint64_t baseSequence, int flags) const
+    {
+        auto segment          = std::make_shared<Segment>();
+        segment->baseSequence = baseSequence;
+        segment->path         = path;
+        segment->fd           = open(path.c_str(), flags, 0644);
+        if (segment->fd < 0)
+        {
+            throwSystemError("open " + path.string());
+        }
+        return segment;
+    }
+
+    // Allocates the blocks of the file up to the length. Records are written through a shared mapping, where a full disk
+    // would raise SIGBUS on a hole of a sparse file instead of failing a call.
+    static void reserveSegment(const Segment& segment, std::size_t length)
+    {
+        if (const int error = posix_fallocate(segment.fd, 0, static_cast<off_t>(length)); error != 0)
+        {
+            errno = error;
+            throwSystemError("fallocate " + segment.path.string());
+        }
+    }
+
+    // A file which could not be set up is removed, so the next rotation does not fail on it
+    std::shared_ptr<Segment> createSegment(uint64_t baseSequence) const
+    {
+        auto segment = openSegment(segmentPath(baseSequence), baseSequence, O_RDWR | O_CREAT | O_EXCL);
+        try
+        {
+            reserveSegment(*segment, config.segmentSize);
+            mapSegment(*segment, config.segmentSize, true);
+        }
+        catch (const std::system_error&)
+        {
+            unlink(segment->path.c_str());
+            throw;
+        }
+        syncDirectory();
+        return segment;
+    }
+
+    // Shrinks the file to the occupied bytes, flushes it and maps it read-only
+    static void sealSegment(Segment& segment)
+    {
+        if (ftruncate(segment.fd, static_cast<off_t>(segment.size)) != 0 || fdatasync(segment.fd) != 0)
+        {
+            throwSystemError("seal " + segment.path.string());
+        }
+        mapSegment(segment, segment.size, false);
+    }
+
+    // Must be called under the unique lock. The active segment is never empty here, since records fit into a segment.
+    void rotate()
+    {
+        try
+        {
+            sealSegment(*activeSegment);
+        }
+        catch (const std::system_error& e)
+        {
+            std::scoped_lock commitLock(mtxCommit);
+            commitError = e.code();
+            cvDurable.notify_all();
+            cvCommit.notify_all();
+            throw;
+        }
+        {
+            std::scoped_lock commitLock(mtxCommit);
+            durableSequence = writtenSequence;
+            pendingBytes    = 0;
+        }
+        cvDurable.notify_all();
+        cvCommit.notify_all();  // to run the callbacks of the sealed records
+
+        activeSegment = createSegment(nextSequence);
+        segments.emplace(activeSegment->baseSequence, activeSegment);
+    }
+
+    std::shared_ptr<Segment> rewriteSegment(const Segment& source, std::size_t liveBytes, uint64_t retainFromTimestamp) const
+    {
+        std::filesystem::path tmpPath = source.path;
+        tmpPath += ".compact";
+
+        auto segment = openSegment(tmpPath, source.baseSequence, O_RDWR | O_CREAT | O_TRUNC);
+        reserveSegment(*segment, liveBytes);
+        mapSegment(*segment, liveBytes, true);
+
+        forEachRecord(source, [&](const RecordHeader& header, std::size_t offset, std::size_t recordSize) {
+            if (header.timestamp >= retainFromTimestamp)
+            {
+                std::memcpy(segment->data + segment->size, source.data + offset, recordSize);
+                segment->size += recordSize;
+            }
+        });
+
+        if (fdatasync(segment->fd) != 0)
+        {
+            throwSystemError("fdatasync " + tmpPath.string());
+        }
+        mapSegment(*segment, liveBytes, false);
+
+        std::filesystem::rename(tmpPath, source.path);
+        segment->path = source.path;
+        return segment;
+    }
+
+    // Must be called under the unique lock
+    void addToIndex(const RecordHeader& header, const Segment* segment, std::size_t offset)
+    {
+        auto& entries = index[header.userId];
+        if (entries.empty() || entries.back().timestamp <= header.timestamp)
+        {
+            entries.push_back({header.timestamp, segment, offset});
+        }
+        else
+        {
+            auto it = std::upper_bound(entries.begin(), entries.end(), header.timestamp,
+                                       [](uint64_t ts, const IndexEntry& entry) { return ts < entry.timestamp; });
+            entries.insert(it, {header.timestamp, segment, offset});
+        }
+    }
+
+    // Rebuilds segments and the index from the directory, dropping a torn tail of the last segment
+    void recover()
+    {
+        std::map<uint64_t, std::filesystem::path> files;
+        for (const auto& entry : std::filesystem::directory_iterator(config.directory))
+        {
+            const std::string name = entry.path().filename().string();
+            if (entry.path().extension() == ".compact")
+            {
+                std::filesystem::remove(entry.path());
+            }
+            else if (name.rfind("segment-", 0) == 0 && entry.path().extension() == ".log")
+            {
+                files.emplace(std::stoull(name.substr(8, 20)), entry.path());
+            }
+        }
+
+        uint64_t lastSequence = 0;
+        for (auto it = files.begin(); it != files.end(); ++it)
+        {
+            const bool isLast = std::next(it) == files.end();
+            auto segment      = openSegment(it->second, it->first, O_RDWR);
+
+            struct stat st;
+            if (fstat(segment->fd, &st) != 0)
+            {
+                throwSystemError("fstat " + it->second.string());
+            }
+            const std::size_t fileSize = static_cast<std::size_t>(st.st_size);
+
+            if (isLast)
+            {
+                // The file may have been left sparse, so its blocks are allocated even if it is large enough
+                const std::size_t capacity = std::max(fileSize, config.segmentSize);
+                reserveSegment(*segment, capacity);
+                mapSegment(*segment, capacity, true);
+            }
+            else if (fileSize > 0)
+            {
+                mapSegment(*segment, fileSize, false);
+            }
+
+            segment->size = segment->data ? forEachRecord(*segment,
+                                                          [&](const RecordHeader& header, std::size_t offset, std::size_t) {
+                                                              addToIndex(header, segment.get(), offset);
+                                                              lastSequence = std::max(lastSequence, header.sequence);
+                                                          })
+                                          : 0;
+
+            if (isLast)
+            {
+                // Garbage of a torn write could be followed by older complete records which would be
+                // taken for valid ones once new records are appended in front of them
+                static constexpr RecordHeader zeroHeader{0u, 0u, 0u, 0u, 0u, 0u};
+                const std::size_t tail = std::min(sizeof(RecordHeader), segment->capacity - segment->size);
+                if (std::memcmp(segment->data + segment->size, &zeroHeader, tail) != 0)
+                {
+                    std::memset(segment->data + segment->size, 0, segment->capacity - segment->size);
+                }
+                if (fdatasync(segment->fd) != 0)
+                {
+                    throwSystemError("fdatasync " + it->second.string());
+                }
+                activeSegment = segment;
+            }
+            else if (segment->size == 0)
+            {
+                std::filesystem::remove(it->second);
+                continue;
+            }
+            else if (segment->size < fileSize)
+            {
+                sealSegment(*segment);
+            }
+
+            segments.emplace(it->first, segment);
+        }
+
+        // Records of the last segment may all be torn while the previous segments have been compacted away.
+        // Sequence numbers below its base were given out already, so they are not reused.
+        nextSequence    = std::max(lastSequence + 1, files.empty() ? uint64_t{1} : files.rbegin()->first);
+        writtenSequence = nextSequence - 1;
+        durableSequence = nextSequence - 1;
+
+        if (!activeSegment)
+        {
+            activeSegment = createSegment(nextSequence);
+            segments.emplace(activeSegment->baseSequence, activeSegment);
+        }
+    }
+
+    // Must be called under mtxCommit, which is released while the callbacks run
+    void runDurableCallbacks(std::unique_lock<std::mutex>& lock)
+    {
+        const auto end = commitError ? durableCallbacks.end() : durableCallbacks.upper_bound(durableSequence);
+        if (end == durableCallbacks.begin())
+        {
+            return;
+        }
+
+        std::vector<std::pair<uint64_t, DurableCallback>> ready(std::make_move_iterator(durableCallbacks.begin()), std::make_move_iterator(end));
+        durableCallbacks.erase(durableCallbacks.begin(), end);
+        const uint64_t durable      = durableSequence;
+        const std::error_code error = commitError;
+
+        lock.unlock();
+        for (auto& [sequence, callback] : ready)
+        {
+            callback(sequence <= durable ? std::error_code() : error);
+        }
+        lock.lock();
+    }
+
+    void commitLoop()
+    {
+        std::unique_lock lock(mtxCommit);
+        while (true)
+        {
+            cvCommit.wait(lock, [this]() {
+                return stopping || commitError || writtenSequence > durableSequence ||
+                       (!durableCallbacks.empty() && durableCallbacks.begin()->first <= durableSequence);
+            });
+            runDurableCallbacks(lock);
+            if (commitError || (writtenSequence == durableSequence && stopping))
+            {
+                break;  // failed, or stopping and nothing left to commit
+            }
+            if (writtenSequence == durableSequence)
+            {
+                continue;
+            }
+
+            // Let more writers join the commit
+            cvCommit.wait_for(lock, config.commitInterval,
+                              [this]() { return stopping || syncRequested || pendingBytes >= config.commitBatchBytes; });
+            syncRequested = false;
+            lock.unlock();
+
+            std::shared_ptr<Segment> segment;
+            uint64_t target = 0;
+            {
+                std::shared_lock logLock(mtx);
+                segment = activeSegment;
+
+                std::scoped_lock commitLock(mtxCommit);
+                target       = writtenSequence;
+                pendingBytes = 0;
+            }
+
+            const bool failed = fdatasync(segment->fd) != 0;
+            const int error   = errno;
+            commitsCount.fetch_add(1, std::memory_order_relaxed);
+
+            lock.lock();
+            if (failed || commitError)
+            {
+                // Retrying is no use: the kernel may have dropped the dirty pages, so a later fdatasync could succeed
+                // without the records on disk
+                if (!commitError)
+                {
+                    commitError = std::error_code(error, std::generic_category());
+                }
+                cvDurable.notify_all();
+                runDurableCallbacks(lock);
+                break;
+            }
+            durableSequence = std::max(durableSequence, target);
+            cvDurable.notify_all();
+        }
+    }
+
+    MessageLogConfig config;
+
+    // Guards segments, index and the write position of the active segment
+    mutable std::shared_mutex mtx;
+    std::map<uint64_t, std::shared_ptr<Segment>> segments;  // by base sequence
+    std::shared_ptr<Segment> activeSegment;
+    std::unordered_map<uint32_t, std::vector<IndexEntry>> index;  // by user, sorted by timestamp
+    uint64_t nextSequence = 1;
+
+    // Guards the commit state. Is locked after mtx when both are needed.
+    mutable std::mutex mtxCommit;
+    std::condition_variable cvCommit, cvDurable;
+    uint64_t writtenSequence = 0;
+    uint64_t durableSequence = 0;
+    std::error_code commitError;  // of the first failed flush, the log accepts no records after it
+    std::multimap<uint64_t, DurableCallback> durableCallbacks;  // by sequence
+    std::size_t pendingBytes = 0;
+    bool syncRequested       = false;
+    bool stopping            = false;
+
+    std::mutex mtxCompaction;
+    std::atomic<uint64_t> commitsCount{0};
+    std::thread commitThread;
+};
@@ -1,25 +1,68 @@
 #pragma once
 #include <Network/Common.hpp>
 #include <Network/Connection.hpp>
+#include <Network/LocalEndpoint.hpp>
 #include <Network/Message.hpp>
+#include <Network/ReceiveBufferPool.hpp>
 #include <Network/SafeQueue.hpp>
 #include <boost/asio.hpp>
 #include <memory>
+#include <optional>
 
+#include "AdmissionControl.hpp"
+#include "UringAcceptor.hpp"
 #include "UserRequestHandlers.hpp"
 
 class Server
 {
 public:
-    Server(uint16_t port) : acceptor(service, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port)) {}
+    Server(uint16_t port, MessageLogConfig logConfig = {}, AdmissionConfig admissionConfig = {},
+           Network::ConnectionConfig connectionConfig = {})
+        : admission(std::move(admissionConfig)),
+          connectionConfig(std::move(connectionConfig)),
+          acceptor(service, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port)),
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+          localAcceptor(service),
+#endif
+          messageLogConfig(std::move(logConfig))
+    {
+    }
+
+    virtual ~Server()
+    {
+        stop();
+
+        // Connections hold buffers of receivePool and their pending handlers hold the connections. The connections
+        // are closed and the handlers are run out on this thread before the pool goes away.
+        requestHandlers.reset();
+        messageLog.reset();
+        for (const auto& connection : deqConnections)
+        {
+            connection->disconnect();
+        }
+        deqConnections.clear();
 
-    virtual ~Server() { stop(); }
+        service.restart();
+        service.poll();
+        qMessagesIn.clear();
+    }
 
     bool start()
     {
         try
         {
-            asyncWaitForClientConnection();
+            // Everything a request needs is ready before the first client is accepted
+            messageLog = std::make_shared<MessageLog>(messageLogConfig);
+
+            requestHandlers = std::make_shared<RegistrationRequestHandler>();
+            requestHandlers->setNextHandler(std::make_shared<LoginRequestHandler>())
+                ->setNextHandler(std::make_shared<MessageStoreRequestHandler>(messageLog))
+                ->setNextHandler(std::make_shared<SubscriptionRequestHandler>(topics));
+
+            receivePool = std::make_unique<Network::ReceiveBufferPool>(service);
+            openLocalAcceptor();
+            startAccepting();
+
             static std::size_t threadsCount = std::thread::hardware_concurrency();
             threadsCount > 1 ? --threadsCount : threadsCount = 1;
 
@@ -28,10 +71,6 @@ public:
                 workers.emplace_back(std::thread([this]() { service.run(); }));
             }
 
-            requestHandlers = std::make_shared<RegistrationRequestHandler>();
-            requestHandlers->setNextHandler(std::make_shared<LoginRequestHandler>())
-                ->setNextHandler(std::make_shared<MessageStoreRequestHandler>());
-
             std::cout << "[Server] started!\n";
             return true;
         }
@@ -55,40 +94,118 @@ public:
         }
         workers.clear();
 
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+        if (localAcceptor.is_open())
+        {
+            boost::system::error_code ignored;
+            localAcceptor.close(ignored);
+            std::error_code removeError;
+            std::filesystem::remove(*localSocketPath, removeError);
+        }
+#endif
+
         std::cout << "[SERVER] Stopped!\n";
     }
 
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+    // Sets the path of the Unix domain socket which is served along with the TCP port. Empty path disables it.
+    // By default it is derived from the port the server listens on, so servers on port 0 do not share it.
+    // The directory should be writable by this user only (0700), as the default one is. Must be called before start().
+    void setLocalSocketPath(std::string path) { localSocketPath = std::move(path); }
+#endif
+
+    // Keeps several accepts outstanding on every acceptor, so a burst of connections does not wait for the handlers
     void asyncWaitForClientConnection()
     {
-        acceptor.async_accept([this](std::error_code ec, boost::asio::ip::tcp::socket socket) {
-            if (!ec)
-            {
-                std::cout << "[Server] New Connaction:" << socket.remote_endpoint() << '\n';
-                auto newConnection =
-                    std::make_shared<Network::Connection>(Network::Connection::OwnerType::SERVER, service, std::move(socket), qMessagesIn);
+        asyncWaitForClientConnection(acceptor);
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+        if (localAcceptor.is_open())
+        {
+            asyncWaitForClientConnection(localAcceptor);
+        }
+#endif
+    }
 
-                if (onClientConnect(newConnection))
-                {
-                    deqConnections.push_back(std::move(newConnection));
+    template <class Protocol>
+    void asyncWaitForClientConnection(boost::asio::basic_socket_acceptor<Protocol>& acceptor)
+    {
+        boost::asio::dispatch(getAcceptStrand(acceptor), [this, &acceptor]() {
+            for (std::size_t i = 0; i < admission.getConfig().pendingAccepts; ++i)
+            {
+                asyncAccept(acceptor);
+            }
+        });
+    }
 
-                    deqConnections.back()->connectToClient(nIDClient++);
+    // Sockets rejected by the admission control are reset at once, before anything is allocated for them
+    template <class Protocol>
+    void handleAccept(std::error_code ec, boost::asio::basic_stream_socket<Protocol> socket)
+    {
+        if (ec)
+        {
+            admission.onAcceptError();
+            return;
+        }
 
-                    std::cout << "[" << deqConnections.back()->getID() << "] Connection Approved\n";
-                }
-                else
-                {
-                    std::cout << "[-----] Connection Denied\n";
-                }
-            }
-            else
+        std::optional<boost::asio::ip::address> address;
+        if constexpr (std::is_same_v<Protocol, boost::asio::ip::tcp>)
+        {
+            boost::system::error_code endpointError;
+            const auto endpoint = socket.remote_endpoint(endpointError);
+            if (endpointError)
             {
-                std::cerr << "[Server] New Connaction Error:" << ec.message() << '\n';
+                admission.onAcceptError();
+                return;
             }
+            address = endpoint.address();
+        }
+
+        if (admission.tryAdmit(address) != AdmissionController::Decision::ADMIT)
+        {
+            boost::system::error_code ignored;
+            socket.set_option(boost::asio::socket_base::linger(true, 0), ignored);
+            socket.close(ignored);
+            return;
+        }
+
+        auto newConnection = std::make_shared<Network::Connection>(Network::Connection::OwnerType::SERVER, service,
+                                                                   Network::Connection::Socket(std::move(socket)), qMessagesIn,
+                                                                   receivePool.get(), connectionConfig);
+        // A closed connection leaves the deque at once, so it does not keep its buffers until the next broadcast
+        newConnection->setOnClose([this, address, weakConnection = std::weak_ptr(newConnection)](const std::error_code& reason) {
+            // Is called by a handler of the connection, which holds it
+            auto connection = weakConnection.lock();
+            topics->unsubscribeAll(connection.get());
+            admission.release(address);
+            admission.onClose(reason);
+            boost::asio::post(service, [this, connection]() { removeConnection(connection); });
         });
 
-        asyncWaitForClientConnection();
+        if (onClientConnect(newConnection))
+        {
+            std::scoped_lock lock(mtxConnections);
+            deqConnections.push_back(newConnection);
+            newConnection->connectToClient(nIDClient++);
+        }
+        else
+        {
+            newConnection->setOnClose(nullptr);
+            admission.release(address);
+        }
+    }
+
+    AdmissionStats getAdmissionStats() const { return admission.getStats(); }
+
+    std::size_t getConnectionsCount() const
+    {
+        std::scoped_lock lock(mtxConnections);
+        return deqConnections.size();
     }
 
+    const Network::ReceiveBufferPool* getReceivePool() const { return receivePool.get(); }
+
+    uint16_t getPort() const { return acceptor.local_endpoint().port(); }
+
     void messageClient(std::shared_ptr<Network::Connection> client, const Network::Message& msg)
     {
         if (client && client->isConnected())
@@ -98,35 +215,50 @@ public:
         else
         {
             onClientDisconnect(client);
-            client.reset();
+
+            std::scoped_lock lock(mtxConnections);
             deqConnections.erase(std::remove(deqConnections.begin(), deqConnections.end(), client), deqConnections.end());
         }
     }
 
-    void messageAllClients(const Network::Message& msg, std::shared_ptr<Network::Connection> pIgnoreClient = nullptr)
+    // Sends the message to the subscribers of the topic only and returns their amount
+    std::size_t publish(uint64_t topic, const Network::Message& msg, std::shared_ptr<Network::Connection> pIgnoreClient = nullptr)
     {
-        bool isInvalidClientExist = false;
+        return topics->forEachSubscriber(topic, pIgnoreClient.get(), [&msg](Network::Connection& client) { client.send(msg); });
+    }
 
-        for (auto& client : deqConnections)
+    // Visits every connection. Messages for a group of clients go through publish().
+    // Closed clients are dropped under the lock and reported after it is released, as removeConnection() does.
+    void messageAllClients(const Network::Message& msg, std::shared_ptr<Network::Connection> pIgnoreClient = nullptr)
+    {
+        std::vector<std::shared_ptr<Network::Connection>> closedClients;
         {
-            if (client && client->isConnected())
+            std::scoped_lock lock(mtxConnections);
+
+            for (auto& client : deqConnections)
             {
-                if (client != pIgnoreClient)
+                if (client && client->isConnected())
+                {
+                    if (client != pIgnoreClient)
+                    {
+                        client->send(msg);
+                    }
+                }
+                else
                 {
-                    client->send(msg);
+                    closedClients.push_back(std::move(client));
                 }
             }
-            else
+
+            if (!closedClients.empty())
             {
-                onClientDisconnect(client);
-                client.reset();
-                isInvalidClientExist = true;
+                deqConnections.erase(std::remove(deqConnections.begin(), deqConnections.end(), nullptr), deqConnections.end());
             }
         }
 
-        if (isInvalidClientExist)
+        for (const auto& client : closedClients)
         {
-            deqConnections.erase(std::remove(deqConnections.begin(), deqConnections.end(), nullptr), deqConnections.end());
+            onClientDisconnect(client);
         }
     }
 
@@ -134,7 +266,7 @@ public:
     {
         while (!qMessagesIn.empty())
         {
-            auto& msg = qMessagesIn.front();
+            auto msg = qMessagesIn.pop_front();
             onMessage(msg.remote, msg);
         }
     }
@@ -157,50 +289,257 @@ public:
 
         while (!qMessagesIn.empty())
         {
-            auto& msg = qMessagesIn.front();
+            auto msg = qMessagesIn.pop_front();
             onMessage(msg.remote, msg);
         }
     }
 
 protected:
+    // Is posted by a closed connection
+    void removeConnection(const std::shared_ptr<Network::Connection>& client)
+    {
+        {
+            std::scoped_lock lock(mtxConnections);
+            auto it = std::find(deqConnections.begin(), deqConnections.end(), client);
+            if (!client || it == deqConnections.end())
+            {
+                return;  // already removed by a broadcast
+            }
+            deqConnections.erase(it);
+        }
+        onClientDisconnect(client);
+    }
+
+    using AcceptStrand = boost::asio::strand<boost::asio::io_service::executor_type>;
+
+    // An acceptor is not safe to use from several threads, so its accepts are issued and completed on its strand
+    template <class Protocol>
+    AcceptStrand& getAcceptStrand([[maybe_unused]] const boost::asio::basic_socket_acceptor<Protocol>& acceptor)
+    {
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+        if constexpr (std::is_same_v<Protocol, boost::asio::local::stream_protocol>)
+        {
+            return localAcceptStrand;
+        }
+        else
+#endif
+        {
+            return acceptStrand;
+        }
+    }
+
+    // Must be called on the strand of the acceptor
+    template <class Protocol>
+    void asyncAccept(boost::asio::basic_socket_acceptor<Protocol>& acceptor)
+    {
+        AcceptStrand& strand = getAcceptStrand(acceptor);
+        auto onAccept        = [this, &acceptor, &strand](std::error_code ec, typename Protocol::socket socket) {
+            if (!acceptor.is_open())
+            {
+                return;
+            }
+
+            // Re-arm before handling the socket. Errors like EMFILE repeat at once, so they are retried after a pause.
+            if (!ec)
+            {
+                asyncAccept(acceptor);
+            }
+            else
+            {
+                auto timer = std::make_shared<boost::asio::steady_timer>(service, ACCEPT_RETRY_DELAY);
+                timer->async_wait(boost::asio::bind_executor(strand, [this, &acceptor, timer](std::error_code) { asyncAccept(acceptor); }));
+            }
+
+            handleAccept(ec, std::move(socket));
+        };
+        acceptor.async_accept(boost::asio::bind_executor(strand, std::move(onAccept)));
+    }
+
+    // Replaces a stale socket left by a previous run of this user, but never the socket of a running server.
+    // The local socket is optional: if it cannot be opened, clients keep using TCP.
+    void openLocalAcceptor()
+    {
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+        if (!localSocketPath)
+        {
+            localSocketPath = Network::getLocalSocketPath(getPort());
+        }
+        if (!localSocketPath->empty())
+        {
+            boost::system::error_code ec;
+            if (!Network::isValidLocalSocketPath(*localSocketPath))
+            {
+                ec = boost::asio::error::name_too_long;
+            }
+            else if (Network::isOwnLocalSocket(*localSocketPath))
+            {
+                if (isLocalSocketServed(*localSocketPath))
+                {
+                    ec = boost::asio::error::address_in_use;
+                }
+                else
+                {
+                    std::error_code removeError;
+                    std::filesystem::remove(*localSocketPath, removeError);
+                }
+            }
+
+            if (!ec)
+            {
+                localAcceptor.open(boost::asio::local::stream_protocol(), ec);
+            }
+            if (!ec)
+            {
+                localAcceptor.bind(boost::asio::local::stream_protocol::endpoint(*localSocketPath), ec);
+            }
+            if (!ec)
+            {
+                localAcceptor.listen(boost::asio::socket_base::max_listen_connections, ec);
+            }
+            if (ec)
+            {
+                std::cerr << "[Server] Local socket " << *localSocketPath << " is not available: " << ec.message() << '\n';
+                boost::system::error_code ignored;
+                localAcceptor.close(ignored);
+            }
+        }
+#endif
+    }
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+    // Whether another server accepts connections on the socket. A stale socket refuses them.
+    static bool isLocalSocketServed(const std::string& path)
+    {
+        boost::asio::io_service probeService;
+        boost::asio::local::stream_protocol::socket probe(probeService);
+        boost::system::error_code ec;
+        probe.connect(boost::asio::local::stream_protocol::endpoint(path), ec);
+        return !ec;
+    }
+#endif
+
+    // Uses a multishot accept with the io_uring backend and falls back to async_accept when the kernel lacks it
+    void startAccepting()
+    {
+#ifdef BOOST_ASIO_HAS_IO_URING
+        try
+        {
+            startUringAcceptor(uringAcceptor, acceptor);
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+            if (localAcceptor.is_open())
+            {
+                startUringAcceptor(uringLocalAcceptor, localAcceptor);
+            }
+#endif
+            return;
+        }
+        catch (const std::system_error& e)
+        {
+            std::cerr << "[Server] Multishot accept is not available: " << e.what() << '\n';
+            uringAcceptor.reset();
+        }
+#endif
+        asyncWaitForClientConnection();
+    }
+
+#ifdef BOOST_ASIO_HAS_IO_URING
+    // The ring may be set up while the kernel still rejects the multishot request. The acceptor is torn down then
+    // outside of its own handler and the accepts go through async_accept.
+    template <class Protocol>
+    void startUringAcceptor(std::unique_ptr<UringAcceptor<Protocol>>& uring, boost::asio::basic_socket_acceptor<Protocol>& acceptor)
+    {
+        uring = std::make_unique<UringAcceptor<Protocol>>(service, acceptor, ACCEPT_RETRY_DELAY);
+        uring->start([this](std::error_code ec, typename Protocol::socket socket) { handleAccept(ec, std::move(socket)); },
+                     [this, &uring, &acceptor]() {
+                         boost::asio::post(service, [this, &uring, &acceptor]() {
+                             std::cerr << "[Server] Multishot accept is not supported by the kernel\n";
+                             uring.reset();
+                             asyncWaitForClientConnection(acceptor);
+                         });
+                     });
+    }
+#endif
+
     virtual bool onClientConnect(std::shared_ptr<Network::Connection> client)
     {
         Network::Message message;
-        message.header.id = Network::MessageType::ServerAcceptAnswer;
+        message.header.id       = Network::MessageType::ServerAcceptAnswer;
+        message.header.priority = Network::MessagePriority::CONTROL;
         client->send(message);
         return true;
     }
 
-    virtual void onClientDisconnect(const std::shared_ptr<Network::Connection> client)
-    {
-        std::cout << "Removing client [" << client->getID() << "]\n";
-    }
+    // Is called without mtxConnections held. Closes are counted by AdmissionStats rather than logged here.
+    virtual void onClientDisconnect(const std::shared_ptr<Network::Connection>) {}
 
     virtual void onMessage(std::shared_ptr<Network::Connection> client, const Network::Message& msg)
     {
+        if (msg.isStreamChunk())
+        {
+            onStreamChunk(client, msg);
+            return;
+        }
+
         auto optMessage = requestHandlers->handle(msg);
         if (optMessage.has_value())
         {
             client->send(optMessage.value());
         }
-        else
+    }
+
+    // Receives payloads larger than ConnectionConfig::maxFrameSize chunk by chunk, in order of every stream of a client.
+    // The client may send the next chunks only after the previous ones are released, so a handler which keeps
+    // a copy of the chunk until it is processed asynchronously slows the client down.
+    virtual void onStreamChunk(std::shared_ptr<Network::Connection> client, const Network::Message& chunk)
+    {
+        if (chunk.isStreamEnd())
         {
-            std::cerr << "RequestHandler is not found. Add it in Server::start\n";
+            std::cerr << "[" << client->getID() << "] Stream of type " << static_cast<int>(chunk.header.id) << " is not handled\n";
         }
     }
 
+    static constexpr std::chrono::milliseconds ACCEPT_RETRY_DELAY{10};
+
     // Incoming messages from client
     Network::SafeQueue<Network::Message> qMessagesIn;
 
+    // Accept handlers run on all the service threads
+    mutable std::mutex mtxConnections;
     std::deque<std::shared_ptr<Network::Connection>> deqConnections;
+
+    AdmissionController admission;
+    Network::ConnectionConfig connectionConfig;
     std::deque<std::thread> workers;
 
     boost::asio::io_service service;
 
     boost::asio::ip::tcp::acceptor acceptor;
+    AcceptStrand acceptStrand = boost::asio::make_strand(service);
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+    // Serves clients on the same host, which do not need the TCP loopback stack
+    boost::asio::local::stream_protocol::acceptor localAcceptor;
+    AcceptStrand localAcceptStrand = boost::asio::make_strand(service);
+    std::optional<std::string> localSocketPath;  // is derived from the port by start() unless it is set
+#endif
+#ifdef BOOST_ASIO_HAS_IO_URING
+    std::unique_ptr<UringAcceptor<boost::asio::ip::tcp>> uringAcceptor;
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+    std::unique_ptr<UringAcceptor<boost::asio::local::stream_protocol>> uringLocalAcceptor;
+#endif
+#endif
+
+    // Receive buffers of connections, registered in the service with the io_uring backend
+    std::unique_ptr<Network::ReceiveBufferPool> receivePool;
 
     // All clients have unique ID in a wide system
     uint32_t nIDClient = 10000;
 
     std::shared_ptr<IRequestHandler> requestHandlers;
+
+    // Subscribers of every topic. Connections leave it when they are closed.
+    std::shared_ptr<TopicIndex<Network::Connection>> topics = std::make_shared<TopicIndex<Network::Connection>>();
+
+    // Persistent storage of user messages
+    MessageLogConfig messageLogConfig;
+    std::shared_ptr<MessageLog> messageLog;
 };
@@ -0,0 +1,195 @@
+#pragma once
+#include <Network/Common.hpp>
+#include <array>
+#include <iterator>
+#include <shared_mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+// Subscribers of every topic. A publish visits the subscribers of its topic only, so its cost does not depend
+// on the amount of connections of the server.
+//
+// Subscribers of a topic are an immutable snapshot, which a subscribe or an unsubscribe replaces with a modified copy.
+// A publish only takes the shared lock of the topic's shard to grab the snapshot and visits it without locks, so
+// publishes neither wait for each other nor hold off the subscription churn for long. Topics of every subscriber are
+// kept as well, so all its subscriptions are dropped when it disconnects. Subscriber has to provide isConnected().
+//
+// The price is paid by the churn: a subscribe or an unsubscribe copies all subscribers of the topic, so it costs
+// O(subscribers of the topic) and the churn of a topic with many thousands of subscribers is slow. Such hot topics
+// are fine while their subscribers stay, which is the usual case. Amount of topics of a subscriber is limited by
+// maxSubscriptions, so one client can neither grow the index without bound nor make every topic hot.
+template <class Subscriber>
+class TopicIndex
+{
+public:
+    static constexpr std::size_t SHARDS_COUNT              = 64;
+    static constexpr std::size_t DEFAULT_MAX_SUBSCRIPTIONS = 1024;
+
+    explicit TopicIndex(std::size_t maxSubscriptionsPerSubscriber = DEFAULT_MAX_SUBSCRIPTIONS)
+        : maxSubscriptions(maxSubscriptionsPerSubscriber)
+    {
+    }
+
+    // Returns false if the subscription exists, the subscriber has maxSubscriptions topics already or it is not
+    // connected any more. The latter is checked under the lock taken by unsubscribeAll(), so a subscriber closed
+    // meanwhile is not kept.
+    bool subscribe(uint64_t topic, const std::shared_ptr<Subscriber>& subscriber)
+    {
+        SubscriberShard& subscriberShard = getSubscriberShard(subscriber.get());
+        std::scoped_lock subscriberLock(subscriberShard.mtx);
+
+        if (!subscriber->isConnected())
+        {
+            return false;
+        }
+
+        auto& subscriptions = subscriberShard.topics[subscriber.get()];
+        if (subscriptions.size() >= maxSubscriptions || !subscriptions.insert(topic).second)
+        {
+            if (subscriptions.empty())
+            {
+                subscriberShard.topics.erase(subscriber.get());
+            }
+            return false;
+        }
+
+        TopicShard& topicShard = getTopicShard(topic);
+        std::unique_lock topicLock(topicShard.mtx);
+
+        SubscribersPtr& subscribers = topicShard.topics[topic];
+        auto updated                = subscribers ? std::make_shared<Subscribers>(*subscribers) : std::make_shared<Subscribers>();
+        updated->push_back(subscriber);
+        subscribers = std::move(updated);
+        return true;
+    }
+
+    bool unsubscribe(uint64_t topic, const Subscriber* subscriber)
+    {
+        SubscriberShard& subscriberShard = getSubscriberShard(subscriber);
+        std::scoped_lock subscriberLock(subscriberShard.mtx);
+
+        auto it = subscriberShard.topics.find(subscriber);
+        if (it == subscriberShard.topics.end() || it->second.erase(topic) == 0)
+        {
+            return false;
+        }
+        if (it->second.empty())
+        {
+            subscriberShard.topics.erase(it);
+        }
+
+        removeFromTopic(topic, subscriber);
+        return true;
+    }
+
+    // Is called when the subscriber disconnects
+    void unsubscribeAll(const Subscriber* subscriber)
+    {
+        SubscriberShard& subscriberShard = getSubscriberShard(subscriber);
+        std::scoped_lock subscriberLock(subscriberShard.mtx);
+
+        auto it = subscriberShard.topics.find(subscriber);
+        if (it == subscriberShard.topics.end())
+        {
+            return;
+        }
+
+        for (const uint64_t topic : it->second)
+        {
+            removeFromTopic(topic, subscriber);
+        }
+        subscriberShard.topics.erase(it);
+    }
+
+    // Calls visitor(Subscriber&) for every subscriber of the topic except the given one and returns their amount.
+    // The visitor runs on the snapshot taken at the call, so subscriptions changed meanwhile are not seen.
+    template <class Visitor>
+    std::size_t forEachSubscriber(uint64_t topic, const Subscriber* except, Visitor&& visitor) const
+    {
+        const SubscribersPtr subscribers = getSubscribers(topic);
+        if (!subscribers)
+        {
+            return 0;
+        }
+
+        std::size_t visited = 0;
+        for (const auto& subscriber : *subscribers)
+        {
+            if (subscriber.get() != except)
+            {
+                visitor(*subscriber);
+                ++visited;
+            }
+        }
+        return visited;
+    }
+
+    std::size_t getSubscribersCount(uint64_t topic) const
+    {
+        const SubscribersPtr subscribers = getSubscribers(topic);
+        return subscribers ? subscribers->size() : 0;
+    }
+
+private:
+    using Subscribers    = std::vector<std::shared_ptr<Subscriber>>;
+    using SubscribersPtr = std::shared_ptr<const Subscribers>;
+
+    struct alignas(64) TopicShard
+    {
+        mutable std::shared_mutex mtx;
+        std::unordered_map<uint64_t, SubscribersPtr> topics;
+    };
+
+    struct alignas(64) SubscriberShard
+    {
+        std::mutex mtx;
+        std::unordered_map<const Subscriber*, std::unordered_set<uint64_t>> topics;
+    };
+
+    SubscribersPtr getSubscribers(uint64_t topic) const
+    {
+        const TopicShard& topicShard = getTopicShard(topic);
+        std::shared_lock topicLock(topicShard.mtx);
+
+        auto it = topicShard.topics.find(topic);
+        return it != topicShard.topics.end() ? it->second : nullptr;
+    }
+
+    void removeFromTopic(uint64_t topic, const Subscriber* subscriber)
+    {
+        TopicShard& topicShard = getTopicShard(topic);
+        std::unique_lock topicLock(topicShard.mtx);
+
+        auto it = topicShard.topics.find(topic);
+        if (it == topicShard.topics.end())
+        {
+            return;
+        }
+
+        if (it->second->size() == 1)
+        {
+            topicShard.topics.erase(it);
+            return;
+        }
+
+        auto updated = std::make_shared<Subscribers>();
+        updated->reserve(it->second->size() - 1);
+        std::copy_if(it->second->begin(), it->second->end(), std::back_inserter(*updated),
+                     [subscriber](const auto& other) { return other.get() != subscriber; });
+        it->second = std::move(updated);
+    }
+
+    TopicShard& getTopicShard(uint64_t topic) { return topicShards[std::hash<uint64_t>{}(topic) % SHARDS_COUNT]; }
+    const TopicShard& getTopicShard(uint64_t topic) const { return topicShards[std::hash<uint64_t>{}(topic) % SHARDS_COUNT]; }
+
+    SubscriberShard& getSubscriberShard(const Subscriber* subscriber)
+    {
+        // Low bits of heap addresses are alike because of the alignment
+        return subscriberShards[(reinterpret_cast<std::uintptr_t>(subscriber) >> 6) % SHARDS_COUNT];
+    }
+
+    const std::size_t maxSubscriptions;
+
+    std::array<TopicShard, SHARDS_COUNT> topicShards;
+    std::array<SubscriberShard, SHARDS_COUNT> subscriberShards;
+};
@@ -0,0 +1,171 @@
+#pragma once
+#ifdef BOOST_ASIO_HAS_IO_URING
+#include <liburing.h>
+#include <sys/eventfd.h>
+
+#include <Network/Common.hpp>
+#include <boost/asio.hpp>
+#include <functional>
+#include <system_error>
+
+// Accepts connections of a listening acceptor with a single multishot accept request (Linux 5.19+).
+//
+// Asio does not expose multishot operations, so the request lives in a small ring of its own. The completions
+// of that ring are signalled through an eventfd which is waited for by the io_context, so the handler runs on
+// the service threads like the handler of async_accept would.
+//
+// A kernel without multishot accept fails the first request with EINVAL: onUnsupported is called then instead of
+// onAccept and nothing is submitted any more, so the owner can fall back to async_accept. Other errors end
+// the request as well and it is submitted again after retryDelay, since errors like EMFILE repeat at once.
+template <class Protocol>
+class UringAcceptor
+{
+public:
+    using Acceptor      = boost::asio::basic_socket_acceptor<Protocol>;
+    using Socket        = typename Protocol::socket;
+    using AcceptHandler = std::function<void(std::error_code, Socket)>;
+
+    UringAcceptor(boost::asio::io_service& service, Acceptor& acceptor, std::chrono::milliseconds retryDelay)
+        : service(service),
+          acceptor(acceptor),
+          protocol(acceptor.local_endpoint().protocol()),
+          eventDescriptor(service),
+          retryTimer(service),
+          retryDelay(retryDelay)
+    {
+        if (const int ret = io_uring_queue_init(QUEUE_DEPTH, &ring, 0); ret < 0)
+        {
+            throw std::system_error(-ret, std::generic_category(), "io_uring_queue_init");
+        }
+
+        const int eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (eventFd < 0 || io_uring_register_eventfd(&ring, eventFd) < 0)
+        {
+            const int error = errno;
+            if (eventFd >= 0)
+            {
+                close(eventFd);
+            }
+            io_uring_queue_exit(&ring);
+            throw std::system_error(error, std::generic_category(), "io_uring_register_eventfd");
+        }
+        eventDescriptor.assign(eventFd);
+    }
+
+    UringAcceptor(const UringAcceptor&) = delete;
+
+    virtual ~UringAcceptor()
+    {
+        retryTimer.cancel();
+        eventDescriptor.close();
+        io_uring_queue_exit(&ring);
+    }
+
+    void start(AcceptHandler handler, std::function<void()> unsupportedHandler)
+    {
+        onAccept      = std::move(handler);
+        onUnsupported = std::move(unsupportedHandler);
+        submitAccept();
+        waitForCompletions();
+    }
+
+private:
+    static constexpr unsigned QUEUE_DEPTH = 64;
+
+    void submitAccept()
+    {
+        io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+        io_uring_prep_multishot_accept(sqe, acceptor.native_handle(), nullptr, nullptr, SOCK_CLOEXEC);
+        io_uring_submit(&ring);
+    }
+
+    void waitForCompletions()
+    {
+        eventDescriptor.async_wait(boost::asio::posix::descriptor_base::wait_read, [this](std::error_code ec) {
+            if (ec)
+            {
+                return;
+            }
+
+            uint64_t counter = 0;
+            [[maybe_unused]] const ssize_t ret = read(eventDescriptor.native_handle(), &counter, sizeof(counter));
+
+            bool resubmit     = false;
+            io_uring_cqe* cqe = nullptr;
+            while (io_uring_peek_cqe(&ring, &cqe) == 0)
+            {
+                const int res   = cqe->res;
+                const bool more = cqe->flags & IORING_CQE_F_MORE;
+                io_uring_cqe_seen(&ring, cqe);
+
+                if (res == -EINVAL && !completed)
+                {
+                    onUnsupported();
+                    return;
+                }
+                completed = true;
+
+                Socket socket(service);
+                boost::system::error_code acceptError;
+                if (res >= 0)
+                {
+                    socket.assign(protocol, res, acceptError);
+                    if (acceptError)
+                    {
+                        close(res);
+                    }
+                }
+                else
+                {
+                    acceptError = boost::system::error_code(-res, boost::system::system_category());
+                }
+                onAccept(acceptError, std::move(socket));
+
+                // The kernel stops a multishot request on errors and when the completion queue overflows
+                if (!more)
+                {
+                    if (res < 0)
+                    {
+                        scheduleRetry();
+                    }
+                    else
+                    {
+                        resubmit = true;
+                    }
+                }
+            }
+
+            if (resubmit)
+            {
+                submitAccept();
+            }
+            waitForCompletions();
+        });
+    }
+
+    void scheduleRetry()
+    {
+        retryTimer.expires_after(retryDelay);
+        retryTimer.async_wait([this](std::error_code ec) {
+            if (!ec)
+            {
+                submitAccept();
+            }
+        });
+    }
+
+    boost::asio::io_service& service;
+    Acceptor& acceptor;
+    Protocol protocol;
+
+    io_uring ring;
+    boost::asio::posix::stream_descriptor eventDescriptor;
+    boost::asio::steady_timer retryTimer;
+    std::chrono::milliseconds retryDelay;
+    bool completed = false;  // a completion other than EINVAL of an unsupported request has arrived
+
+    AcceptHandler onAccept;
+    std::function<void()> onUnsupported;
+};
+
+#endif
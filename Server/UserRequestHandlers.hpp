@@ -1,9 +1,14 @@
+#include <Network/Connection.hpp>
 #include <Network/Message.hpp>
 #include <optional>
 
+#include "MessageLog.hpp"
+#include "TopicIndex.hpp"
+
 struct IRequestHandler
 {
     virtual std::shared_ptr<IRequestHandler> setNextHandler(std::shared_ptr<IRequestHandler> next) = 0;
+    // Returns the answer, or nothing if the handler sends the answer itself later
     virtual std::optional<Network::Message> handle(const Network::Message& msg)                    = 0;
 };
 
@@ -25,6 +30,7 @@ public:
             return nextHandler->handle(msg);
         }
 
+        std::cerr << "RequestHandler is not found. Add it in Server::start\n";
         return std::nullopt;
     }
 
@@ -39,7 +45,8 @@ class RegistrationRequestHandler : public AbstractRequestHandler
         if (msg.header.id == Network::MessageType::RegistrationRequest)
         {
             Network::Message msgAnswer;
-            msgAnswer.header.id = Network::MessageType::RegistrationAnswer;
+            msgAnswer.header.id       = Network::MessageType::RegistrationAnswer;
+            msgAnswer.header.priority = Network::MessagePriority::CONTROL;
             // logic ...
             return msgAnswer;
         }
@@ -57,7 +64,8 @@ class LoginRequestHandler : public AbstractRequestHandler
         if (msg.header.id == Network::MessageType::LoginRequest)
         {
             Network::Message msgAnswer;
-            msgAnswer.header.id = Network::MessageType::LoginAnswer;
+            msgAnswer.header.id       = Network::MessageType::LoginAnswer;
+            msgAnswer.header.priority = Network::MessagePriority::CONTROL;
             // logic ...
             return msgAnswer;
         }
@@ -70,13 +78,111 @@ class LoginRequestHandler : public AbstractRequestHandler
 
 class MessageStoreRequestHandler : public AbstractRequestHandler
 {
+public:
+    explicit MessageStoreRequestHandler(std::shared_ptr<MessageLog> log) : messageLog(std::move(log)) {}
+
+    // Request body: [text][uint32_t userId]. Answer body: [uint64_t sequence][uint64_t timestamp], empty for a malformed request
+    // or a record which could not be stored. The answer is sent once the group commit of MessageLog has put the record on disk,
+    // so the update loop does not wait for the commit.
     std::optional<Network::Message> handle(const Network::Message& msg) override
     {
         if (msg.header.id == Network::MessageType::MessageStoreRequest)
         {
             Network::Message msgAnswer;
-            msgAnswer.header.id = Network::MessageType::MessageStoreAnswer;
-            // logic ...
+            msgAnswer.header.id       = Network::MessageType::MessageStoreAnswer;
+            msgAnswer.header.priority = Network::MessagePriority::CONTROL;
+            if (msg.body.size() < sizeof(uint32_t) || !msg.remote)
+            {
+                return msgAnswer;
+            }
+
+            Network::Message request = msg;
+            uint32_t userId          = 0;
+            request >> userId;
+
+            const uint64_t timestamp = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+            uint64_t sequence = 0;
+            try
+            {
+                sequence = messageLog->append(userId, timestamp, request.body);
+            }
+            catch (const std::exception& e)
+            {
+                std::cerr << "[MessageStore] " << e.what() << '\n';
+                return msgAnswer;
+            }
+
+            messageLog->onDurable(sequence, [remote = msg.remote, msgAnswer, sequence, timestamp](const std::error_code& ec) mutable {
+                if (!ec)
+                {
+                    msgAnswer << sequence << timestamp;
+                }
+                remote->send(msgAnswer);
+            });
+            return std::nullopt;
+        }
+        else
+        {
+            return AbstractRequestHandler::handle(msg);
+        }
+    }
+
+private:
+    std::shared_ptr<MessageLog> messageLog;
+};
+
+class SubscriptionRequestHandler : public AbstractRequestHandler
+{
+public:
+    explicit SubscriptionRequestHandler(std::shared_ptr<TopicIndex<Network::Connection>> index) : topics(std::move(index)) {}
+
+    // Subscribe and unsubscribe request body: [uint64_t topic]. Answer body: [uint8_t done]. A subscribe is not done
+    // if the connection has TopicIndex::maxSubscriptions topics already.
+    // Publish request body: [payload][uint64_t topic]. It is delivered as TopicMessage with the same body to the other
+    // subscribers of the topic. Answer body: [uint32_t amount of subscribers reached].
+    // Answers to malformed requests are empty.
+    std::optional<Network::Message> handle(const Network::Message& msg) override
+    {
+        if (msg.header.id == Network::MessageType::SubscribeRequest || msg.header.id == Network::MessageType::UnsubscribeRequest)
+        {
+            const bool subscribe = msg.header.id == Network::MessageType::SubscribeRequest;
+
+            Network::Message msgAnswer;
+            msgAnswer.header.id       = subscribe ? Network::MessageType::SubscribeAnswer : Network::MessageType::UnsubscribeAnswer;
+            msgAnswer.header.priority = Network::MessagePriority::CONTROL;
+            if (msg.body.size() != sizeof(uint64_t) || !msg.remote)
+            {
+                return msgAnswer;
+            }
+
+            uint64_t topic = 0;
+            std::memcpy(&topic, msg.body.data(), sizeof(topic));
+            const bool done = subscribe ? topics->subscribe(topic, msg.remote) : topics->unsubscribe(topic, msg.remote.get());
+
+            msgAnswer << static_cast<uint8_t>(done);
+            return msgAnswer;
+        }
+        else if (msg.header.id == Network::MessageType::PublishRequest)
+        {
+            Network::Message msgAnswer;
+            msgAnswer.header.id       = Network::MessageType::PublishAnswer;
+            msgAnswer.header.priority = Network::MessagePriority::CONTROL;
+            if (msg.body.size() < sizeof(uint64_t))
+            {
+                return msgAnswer;
+            }
+
+            uint64_t topic = 0;
+            std::memcpy(&topic, msg.body.data() + msg.body.size() - sizeof(topic), sizeof(topic));
+
+            Network::Message topicMessage;
+            topicMessage.header.id = Network::MessageType::TopicMessage;
+            topicMessage.body      = msg.body;
+            const std::size_t delivered =
+                topics->forEachSubscriber(topic, msg.remote.get(), [&topicMessage](Network::Connection& subscriber) { subscriber.send(topicMessage); });
+
+            msgAnswer << static_cast<uint32_t>(delivered);
             return msgAnswer;
         }
         else
@@ -84,4 +190,7 @@ class MessageStoreRequestHandler : public AbstractRequestHandler
             return AbstractRequestHandler::handle(msg);
         }
     }
+
+private:
+    std::shared_ptr<TopicIndex<Network::Connection>> topics;
 };
@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+#include <sys/resource.h>
+
+#include <Server.hpp>
+
+TEST(AdmissionControllerTest, LimitsPerAddressAndGlobally)
+{
+    AdmissionConfig config;
+    config.maxConnections           = 3;
+    config.maxConnectionsPerAddress = 2;
+    AdmissionController admission(config);
+
+    const auto first  = boost::asio::ip::make_address("10.0.0.1");
+    const auto second = boost::asio::ip::make_address("10.0.0.2");
+
+    EXPECT_EQ(admission.tryAdmit(first), AdmissionController::Decision::ADMIT);
+    EXPECT_EQ(admission.tryAdmit(first), AdmissionController::Decision::ADMIT);
+    EXPECT_EQ(admission.tryAdmit(first), AdmissionController::Decision::REJECT_ADDRESS);
+    EXPECT_EQ(admission.tryAdmit(second), AdmissionController::Decision::ADMIT);
+    EXPECT_EQ(admission.tryAdmit(std::nullopt), AdmissionController::Decision::REJECT_LIMIT);
+
+    admission.release(first);
+    EXPECT_EQ(admission.tryAdmit(std::nullopt), AdmissionController::Decision::ADMIT);
+    EXPECT_EQ(admission.getStats().activeConnections, 3u);
+}
+
+TEST(AdmissionControllerTest, TokenBucketLimitsRate)
+{
+    AdmissionConfig config;
+    config.acceptRate  = 0.001;
+    config.acceptBurst = 5;
+    AdmissionController admission(config);
+
+    for (int i = 0; i < 5; ++i)
+    {
+        EXPECT_EQ(admission.tryAdmit(std::nullopt), AdmissionController::Decision::ADMIT);
+    }
+    EXPECT_EQ(admission.tryAdmit(std::nullopt), AdmissionController::Decision::REJECT_RATE);
+    EXPECT_EQ(admission.getStats().rejectedByRate, 1u);
+}
+
+TEST(AdmissionControllerTest, CountsCloses)
+{
+    AdmissionController admission;
+    admission.onClose({});
+    admission.onClose(boost::system::error_code(boost::asio::error::eof));
+    admission.onClose(boost::system::error_code(boost::asio::error::connection_reset));
+    admission.onClose(std::make_error_code(std::errc::protocol_error));
+
+    EXPECT_EQ(admission.getStats().closedConnections, 4u);
+    EXPECT_EQ(admission.getStats().closedOnError, 2u);
+}
+
+class DisconnectCountingServer : public Server
+{
+public:
+    using Server::Server;
+
+    std::atomic<std::size_t> disconnected = 0;
+
+protected:
+    void onClientDisconnect(const std::shared_ptr<Network::Connection>) override { ++disconnected; }
+};
+
+// Thousands of local clients connect at once: the server keeps its cap and rejects the rest instead of stalling
+TEST(ServerAdmissionTest, AcceptStorm)
+{
+    static constexpr std::size_t CLIENTS_COUNT   = 3000;
+    static constexpr std::size_t MAX_CONNECTIONS = 1000;
+
+    // Both sides of every connection live in this process
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    if (limit.rlim_cur < CLIENTS_COUNT + MAX_CONNECTIONS + 100)
+    {
+        GTEST_SKIP() << "Not enough file descriptors";
+    }
+
+    MessageLogConfig logConfig;
+    logConfig.directory = std::filesystem::temp_directory_path() / ("AdmissionTest-" + std::to_string(getpid()));
+
+    AdmissionConfig admissionConfig;
+    admissionConfig.maxConnections           = MAX_CONNECTIONS;
+    admissionConfig.maxConnectionsPerAddress = CLIENTS_COUNT;
+    admissionConfig.acceptRate               = 1e6;
+    admissionConfig.acceptBurst              = CLIENTS_COUNT;
+
+    {
+        DisconnectCountingServer server(0, logConfig, admissionConfig);
+        server.setLocalSocketPath("");
+        ASSERT_TRUE(server.start());
+        const std::size_t freeSlots = server.getReceivePool()->getFreeSlotsCount();
+
+        boost::asio::io_service clientService;
+        const boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), server.getPort());
+
+        std::vector<boost::asio::ip::tcp::socket> clients;
+        clients.reserve(CLIENTS_COUNT);
+        // A rejected client sees either a connected socket which is reset later or the reset itself
+        std::size_t answered = 0;
+        for (std::size_t i = 0; i < CLIENTS_COUNT; ++i)
+        {
+            clients.emplace_back(clientService).async_connect(endpoint, [&answered](std::error_code ec) {
+                if (!ec || ec == std::errc::connection_reset)
+                {
+                    ++answered;
+                }
+            });
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        clientService.run();
+
+        AdmissionStats stats;
+        while (std::chrono::steady_clock::now() - start < std::chrono::seconds(30))
+        {
+            stats = server.getAdmissionStats();
+            if (stats.admitted + stats.rejectedByLimit >= CLIENTS_COUNT)
+            {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        EXPECT_EQ(answered, CLIENTS_COUNT);
+        EXPECT_EQ(stats.admitted, MAX_CONNECTIONS);
+        EXPECT_EQ(stats.activeConnections, MAX_CONNECTIONS);
+        EXPECT_EQ(stats.rejectedByLimit, CLIENTS_COUNT - MAX_CONNECTIONS);
+
+        EXPECT_EQ(server.getConnectionsCount(), MAX_CONNECTIONS);
+
+        // Closed connections give their admission slots and receive buffers back without a broadcast
+        clients.clear();
+        auto released = [&]() {
+            return server.getAdmissionStats().activeConnections == 0 && server.getConnectionsCount() == 0 &&
+                   server.getReceivePool()->getFreeSlotsCount() == freeSlots;
+        };
+        while (!released() && std::chrono::steady_clock::now() - start < std::chrono::seconds(30))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        EXPECT_EQ(server.getAdmissionStats().activeConnections, 0u);
+        EXPECT_EQ(server.getConnectionsCount(), 0u);
+        EXPECT_EQ(server.getReceivePool()->getFreeSlotsCount(), freeSlots);
+        EXPECT_EQ(server.disconnected, MAX_CONNECTIONS);
+        EXPECT_EQ(server.getAdmissionStats().closedConnections, MAX_CONNECTIONS);
+    }
+
+    std::filesystem::remove_all(logConfig.directory);
+}
+
+// The disconnect hook may use the server, since no lock of it is held when it is called
+class ReentrantServer : public Server
+{
+public:
+    using Server::Server;
+
+    void addClosedConnection()
+    {
+        std::scoped_lock lock(mtxConnections);
+        deqConnections.push_back(std::make_shared<Network::Connection>(Network::Connection::OwnerType::SERVER, service,
+                                                                       Network::Connection::Socket(service), qMessagesIn));
+    }
+
+    std::size_t connectionsSeen = 1;
+
+protected:
+    void onClientDisconnect(const std::shared_ptr<Network::Connection>) override { connectionsSeen = getConnectionsCount(); }
+};
+
+TEST(ServerAdmissionTest, DisconnectHookRunsWithoutLock)
+{
+    ReentrantServer server(0);
+    server.addClosedConnection();
+
+    Network::Message msg;
+    msg.header.id = Network::MessageType::TopicMessage;
+    server.messageAllClients(msg);
+    EXPECT_EQ(server.connectionsSeen, 0u);
+}
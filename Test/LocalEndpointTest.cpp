@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+
+#include <Network/Connection.hpp>
+#include <Network/LocalEndpoint.hpp>
+#include <Server.hpp>
+#include <fstream>
+
+TEST(LocalEndpointTest, SocketDirectoryIsPrivate)
+{
+    const std::filesystem::path directory = Network::getLocalSocketDirectory();
+    ASSERT_FALSE(directory.empty());
+
+    struct stat st;
+    ASSERT_EQ(lstat(directory.c_str(), &st), 0);
+    EXPECT_TRUE(S_ISDIR(st.st_mode));
+    EXPECT_EQ(st.st_uid, geteuid());
+    EXPECT_EQ(st.st_mode & 077, 0u);
+
+    EXPECT_EQ(std::filesystem::path(Network::getLocalSocketPath(4242)).parent_path(), directory);
+}
+
+// A client takes only a socket of its own user for the server's one
+TEST(LocalEndpointTest, OnlyOwnSocketIsTrusted)
+{
+    const std::filesystem::path directory = Network::getLocalSocketDirectory();
+    const std::string socketPath          = (directory / ("LocalEndpointTest-" + std::to_string(getpid()) + ".sock")).string();
+    const std::string filePath            = socketPath + ".file";
+    const std::string linkPath            = socketPath + ".link";
+
+    EXPECT_FALSE(Network::isOwnLocalSocket(socketPath));
+    EXPECT_FALSE(Network::isOwnLocalSocket(""));
+
+    boost::asio::io_service service;
+    boost::asio::local::stream_protocol::acceptor acceptor(service, boost::asio::local::stream_protocol::endpoint(socketPath));
+    EXPECT_TRUE(Network::isOwnLocalSocket(socketPath));
+
+    std::ofstream(filePath).put('x');
+    EXPECT_FALSE(Network::isOwnLocalSocket(filePath));
+
+    std::filesystem::create_symlink(socketPath, linkPath);
+    EXPECT_FALSE(Network::isOwnLocalSocket(linkPath));
+
+    acceptor.close();
+    for (const auto& path : {socketPath, filePath, linkPath})
+    {
+        std::filesystem::remove(path);
+    }
+}
+
+// Every server on port 0 serves the socket of its own port, and a socket which is served is not replaced
+TEST(LocalEndpointTest, ServersDoNotShareSocket)
+{
+    MessageLogConfig logConfig;
+    logConfig.directory = std::filesystem::temp_directory_path() / ("LocalEndpointTest-" + std::to_string(getpid()));
+
+    {
+        Server first(0, logConfig);
+        ASSERT_TRUE(first.start());
+        const std::string firstPath = Network::getLocalSocketPath(first.getPort());
+        EXPECT_TRUE(Network::isOwnLocalSocket(firstPath));
+
+        MessageLogConfig secondLogConfig = logConfig;
+        secondLogConfig.directory += "-second";
+        Server second(0, secondLogConfig);
+        ASSERT_TRUE(second.start());
+        EXPECT_TRUE(Network::isOwnLocalSocket(Network::getLocalSocketPath(second.getPort())));
+
+        struct stat before;
+        ASSERT_EQ(lstat(firstPath.c_str(), &before), 0);
+        Server third(0, secondLogConfig);
+        third.setLocalSocketPath(firstPath);
+        ASSERT_TRUE(third.start());
+
+        struct stat after;
+        ASSERT_EQ(lstat(firstPath.c_str(), &after), 0);
+        EXPECT_EQ(after.st_ino, before.st_ino);
+        std::filesystem::remove_all(secondLogConfig.directory);
+    }
+
+    std::filesystem::remove_all(logConfig.directory);
+}
+
+// A socket path longer than a socket address takes leaves the server with TCP only
+TEST(LocalEndpointTest, TooLongPathKeepsTcp)
+{
+    EXPECT_FALSE(Network::isValidLocalSocketPath(std::string(sizeof(sockaddr_un::sun_path), 'a')));
+
+    const std::string name                = "LocalEndpointTest-" + std::to_string(getpid()) + "-" + std::string(sizeof(sockaddr_un::sun_path), 'x');
+    const std::filesystem::path directory = std::filesystem::temp_directory_path() / name;
+    std::filesystem::create_directory(directory);
+    std::filesystem::permissions(directory, std::filesystem::perms::owner_all);
+
+    const char* runtimeDirectory          = std::getenv("XDG_RUNTIME_DIR");
+    const bool hadRuntimeDirectory        = runtimeDirectory != nullptr;
+    const std::string oldRuntimeDirectory = hadRuntimeDirectory ? runtimeDirectory : "";
+    setenv("XDG_RUNTIME_DIR", directory.c_str(), 1);
+    EXPECT_EQ(Network::getLocalSocketPath(4242), "");
+
+    MessageLogConfig logConfig;
+    logConfig.directory = directory / "log";
+    {
+        Server server(0, logConfig);
+        ASSERT_TRUE(server.start());
+
+        boost::asio::io_service clientService;
+        boost::asio::ip::tcp::socket client(clientService);
+        boost::system::error_code ec;
+        client.connect(boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), server.getPort()), ec);
+        EXPECT_FALSE(ec);
+    }
+
+    hadRuntimeDirectory ? setenv("XDG_RUNTIME_DIR", oldRuntimeDirectory.c_str(), 1) : unsetenv("XDG_RUNTIME_DIR");
+    std::filesystem::remove_all(directory);
+}
@@ -0,0 +1,257 @@
+#include <gtest/gtest.h>
+
+#include <MessageLog.hpp>
+#include <Server.hpp>
+#include <sys/resource.h>
+
+#include <csignal>
+#include <fstream>
+
+class MessageLogTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        config.directory   = std::filesystem::temp_directory_path() / ("MessageLogTest-" + std::to_string(getpid()));
+        config.segmentSize = 4096;
+        std::filesystem::remove_all(config.directory);
+    }
+
+    void TearDown() override { std::filesystem::remove_all(config.directory); }
+
+    static std::vector<uint8_t> makeBody(const std::string& text) { return std::vector<uint8_t>(text.begin(), text.end()); }
+
+    MessageLogConfig config;
+};
+
+TEST_F(MessageLogTest, ReadHistoryByUserAndTimestamp)
+{
+    MessageLog log(config);
+    log.append(1, 100, makeBody("a"));
+    log.append(2, 150, makeBody("b"));
+    log.append(1, 300, makeBody("c"));
+    log.append(1, 200, makeBody("d"));
+
+    const auto history = log.readHistory(1, 150, 300);
+    ASSERT_EQ(history.size(), 2u);
+    EXPECT_EQ(history[0].body, makeBody("d"));
+    EXPECT_EQ(history[1].body, makeBody("c"));
+
+    EXPECT_EQ(log.readHistory(1, 0, 1000, 1).front().body, makeBody("a"));
+    EXPECT_TRUE(log.readHistory(3).empty());
+}
+
+TEST_F(MessageLogTest, AppendDurableAndRecover)
+{
+    {
+        MessageLog log(config);
+        for (uint64_t i = 0; i < 200; ++i)
+        {
+            const auto body = makeBody("message " + std::to_string(i));
+            log.appendDurable(static_cast<uint32_t>(i % 4), i, body.data(), body.size());
+        }
+        EXPECT_EQ(log.getDurableSequence(), 200u);
+        EXPECT_GT(log.getSegmentsCount(), 1u);
+    }
+
+    MessageLog log(config);
+    EXPECT_EQ(log.getNextSequence(), 201u);
+
+    const auto history = log.readHistory(3);
+    ASSERT_EQ(history.size(), 50u);
+    EXPECT_EQ(history.back().body, makeBody("message 199"));
+}
+
+TEST_F(MessageLogTest, TornTailIsDropped)
+{
+    std::filesystem::path lastSegment;
+    {
+        MessageLog log(config);
+        log.append(1, 1, makeBody("first"));
+        log.append(1, 2, makeBody("second"));
+        log.sync();
+    }
+
+    for (const auto& entry : std::filesystem::directory_iterator(config.directory))
+    {
+        lastSegment = std::max(lastSegment, entry.path());
+    }
+
+    // Corrupt the payload of the second record
+    {
+        std::fstream file(lastSegment, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(40 + 32);
+        file.put('X');
+    }
+
+    {
+        MessageLog log(config);
+        ASSERT_EQ(log.readHistory(1).size(), 1u);
+        log.append(1, 3, makeBody("3"));
+        log.sync();
+    }
+
+    MessageLog log(config);
+    const auto history = log.readHistory(1);
+    ASSERT_EQ(history.size(), 2u);
+    EXPECT_EQ(history[1].body, makeBody("3"));
+}
+
+// The records of the first segment are compacted away and the only record of the last one is torn
+TEST_F(MessageLogTest, SequenceIsNotReusedAfterRecovery)
+{
+    const std::vector<uint8_t> body(500, 0xAB);
+    std::filesystem::path lastSegment;
+    {
+        MessageLog log(config);
+        for (uint64_t i = 0; i < 8; ++i)
+        {
+            log.append(7, i, body);
+        }
+        log.compact(100);
+        EXPECT_EQ(log.getSegmentsCount(), 1u);
+        log.sync();
+    }
+
+    for (const auto& entry : std::filesystem::directory_iterator(config.directory))
+    {
+        lastSegment = std::max(lastSegment, entry.path());
+    }
+    {
+        std::fstream file(lastSegment, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(40);
+        file.put('X');
+    }
+
+    MessageLog log(config);
+    EXPECT_TRUE(log.readHistory(7).empty());
+    EXPECT_EQ(log.getNextSequence(), 8u);
+    EXPECT_EQ(log.append(7, 8, body), 8u);
+}
+
+TEST_F(MessageLogTest, CompactionDropsExpiredRecords)
+{
+    MessageLog log(config);
+    const std::vector<uint8_t> body(500, 0xAB);
+    for (uint64_t i = 0; i < 40; ++i)
+    {
+        log.append(7, i, body);
+    }
+    const std::size_t segmentsBefore = log.getSegmentsCount();
+
+    // 7 records fit into a segment: the first 4 sealed segments expire completely, the 5th one is rewritten
+    log.compact(32);
+    EXPECT_EQ(log.getSegmentsCount(), segmentsBefore - 4);
+
+    auto history = log.readHistory(7);
+    ASSERT_EQ(history.size(), 8u);
+    EXPECT_EQ(history.front().timestamp, 32u);
+
+    log.append(7, 40, body);
+    log.sync();
+    history = log.readHistory(7, 39);
+    ASSERT_EQ(history.size(), 2u);
+    EXPECT_EQ(history.back().body, body);
+}
+
+TEST_F(MessageLogTest, DurableCallbacksFollowCommit)
+{
+    config.commitInterval = std::chrono::milliseconds(50);
+    MessageLog log(config);
+
+    std::mutex mtx;
+    std::vector<uint64_t> completed;
+    const std::vector<uint8_t> body(500, 0xCD);
+    for (uint64_t i = 0; i < 20; ++i)
+    {
+        const uint64_t sequence = log.append(1, i, body);
+        log.onDurable(sequence, [&, sequence](const std::error_code& ec) {
+            EXPECT_FALSE(ec);
+            // The record is on disk by the time its callback runs
+            EXPECT_GE(log.getDurableSequence(), sequence);
+            std::scoped_lock lock(mtx);
+            completed.push_back(sequence);
+        });
+    }
+
+    log.sync();
+    // Callbacks run on the commit thread after the durable sequence is published
+    for (int i = 0; i < 500; ++i)
+    {
+        {
+            std::scoped_lock lock(mtx);
+            if (completed.size() == 20u)
+            {
+                break;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::scoped_lock lock(mtx);
+    ASSERT_EQ(completed.size(), 20u);
+    EXPECT_TRUE(std::is_sorted(completed.begin(), completed.end()));
+
+    // An already durable record is reported at once
+    bool calledAtOnce = false;
+    log.onDurable(1, [&calledAtOnce](const std::error_code& ec) { calledAtOnce = !ec; });
+    EXPECT_TRUE(calledAtOnce);
+}
+
+// Blocks of a new segment are allocated up front, so a full disk fails the append instead of the write into the mapping.
+// The file size limit stands in for the full disk here.
+TEST_F(MessageLogTest, SegmentWhichCannotBeAllocatedIsRemoved)
+{
+    MessageLog log(config);
+    const auto body = makeBody(std::string(1000, 'x'));
+    log.append(1, 1, body);
+
+    rlimit oldLimit;
+    ASSERT_EQ(getrlimit(RLIMIT_FSIZE, &oldLimit), 0);
+    rlimit limit   = oldLimit;
+    limit.rlim_cur = config.segmentSize / 2;
+    const auto oldHandler = std::signal(SIGXFSZ, SIG_IGN);
+    ASSERT_EQ(setrlimit(RLIMIT_FSIZE, &limit), 0);
+
+    bool failed = false;
+    for (int i = 0; i < 10 && !failed; ++i)
+    {
+        try
+        {
+            log.append(1, 1, body);
+        }
+        catch (const std::system_error&)
+        {
+            failed = true;
+        }
+    }
+
+    setrlimit(RLIMIT_FSIZE, &oldLimit);
+    std::signal(SIGXFSZ, oldHandler);
+    ASSERT_TRUE(failed);
+    EXPECT_EQ(std::distance(std::filesystem::directory_iterator(config.directory), std::filesystem::directory_iterator()), 1);
+
+    // The next rotation creates the segment again
+    const uint64_t sequence = log.append(1, 1, body);
+    log.waitDurable(sequence);
+    EXPECT_EQ(log.getSegmentsCount(), 2u);
+}
+
+// A server whose log cannot be opened does not start, so no client reaches the missing request handlers
+TEST_F(MessageLogTest, ServerWithoutLogDoesNotAccept)
+{
+    std::ofstream(config.directory).put('x');
+
+    Server server(0, config);
+    server.setLocalSocketPath("");
+    EXPECT_FALSE(server.start());
+
+    boost::asio::io_service clientService;
+    boost::asio::ip::tcp::socket client(clientService);
+    boost::system::error_code ec;
+    client.connect(boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), server.getPort()), ec);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    server.update();
+
+    EXPECT_EQ(server.getConnectionsCount(), 0u);
+    EXPECT_EQ(server.getAdmissionStats().admitted, 0u);
+}
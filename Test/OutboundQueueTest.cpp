@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+
+#include <Network/OutboundQueue.hpp>
+
+static Network::Message makeMessage(Network::MessagePriority priority, std::size_t bodySize)
+{
+    Network::Message msg;
+    msg.header.id       = Network::MessageType::MessageStoreRequest;
+    msg.header.priority = priority;
+    msg.body.resize(bodySize);
+    return msg;
+}
+
+TEST(OutboundQueueTest, ControlOvertakesQueuedBulk)
+{
+    Network::OutboundQueue queue;
+    for (int i = 0; i < 100; ++i)
+    {
+        queue.push(makeMessage(Network::MessagePriority::BULK, 1024));
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        queue.push(makeMessage(Network::MessagePriority::CONTROL, 16));
+    }
+
+    for (int i = 0; i < 3; ++i)
+    {
+        EXPECT_EQ(queue.pop()->header.priority, Network::MessagePriority::CONTROL);
+    }
+    EXPECT_EQ(queue.pop()->header.priority, Network::MessagePriority::BULK);
+    EXPECT_EQ(queue.size(), 99u);
+}
+
+// A control message queued while bulk data is being sent waits for one bulk quantum at most
+TEST(OutboundQueueTest, ControlWaitsForOneQuantumAtMost)
+{
+    static constexpr std::size_t BODY_SIZE = 1024;
+
+    Network::OutboundQueue queue;
+    for (int i = 0; i < 1000; ++i)
+    {
+        queue.push(makeMessage(Network::MessagePriority::BULK, BODY_SIZE));
+    }
+    queue.pop();
+    queue.push(makeMessage(Network::MessagePriority::CONTROL, 16));
+
+    std::size_t bulkBefore = 0;
+    while (queue.pop()->header.priority != Network::MessagePriority::CONTROL)
+    {
+        ++bulkBefore;
+    }
+    EXPECT_LE(bulkBefore * (BODY_SIZE + sizeof(Network::MessageHeader)),
+              Network::OutboundQueue::WEIGHTS[static_cast<std::size_t>(Network::MessagePriority::BULK)] * Network::OutboundQueue::QUANTUM);
+}
+
+TEST(OutboundQueueTest, BacklogsShareBandwidthByWeight)
+{
+    static constexpr std::size_t BODY_SIZE = 1024 - sizeof(Network::MessageHeader);
+
+    Network::OutboundQueue queue;
+    for (int i = 0; i < 10000; ++i)
+    {
+        queue.push(makeMessage(Network::MessagePriority::CONTROL, BODY_SIZE));
+        queue.push(makeMessage(Network::MessagePriority::NORMAL, BODY_SIZE));
+        queue.push(makeMessage(Network::MessagePriority::BULK, BODY_SIZE));
+    }
+
+    // Ten full rounds while every lane is backlogged
+    std::array<std::size_t, Network::MESSAGE_PRIORITIES_COUNT> sent{};
+    const std::size_t perRound = (8 + 4 + 1) * Network::OutboundQueue::QUANTUM / 1024;
+    for (std::size_t i = 0; i < 10 * perRound; ++i)
+    {
+        ++sent[static_cast<std::size_t>(queue.pop()->header.priority)];
+    }
+
+    EXPECT_EQ(sent[0], 10 * 8 * Network::OutboundQueue::QUANTUM / 1024);
+    EXPECT_EQ(sent[1], 10 * 4 * Network::OutboundQueue::QUANTUM / 1024);
+    EXPECT_EQ(sent[2], 10 * 1 * Network::OutboundQueue::QUANTUM / 1024);
+}
+
+// A bulk message larger than its quantum gets sent although control messages keep arriving
+TEST(OutboundQueueTest, LargeBulkMessageIsNotStarved)
+{
+    Network::OutboundQueue queue;
+    queue.push(makeMessage(Network::MessagePriority::BULK, 4u * 1024u * 1024u));
+
+    std::size_t controlSent = 0;
+    while (true)
+    {
+        queue.push(makeMessage(Network::MessagePriority::CONTROL, 1024));
+        if (queue.pop()->header.priority == Network::MessagePriority::BULK)
+        {
+            break;
+        }
+        ++controlSent;
+        ASSERT_LT(controlSent, 1000000u);
+    }
+    EXPECT_EQ(queue.size(), 1u);
+}
+
+TEST(OutboundQueueTest, UnknownPriorityGoesToLowestLane)
+{
+    Network::OutboundQueue queue;
+    queue.push(makeMessage(static_cast<Network::MessagePriority>(200), 16));
+    queue.push(makeMessage(Network::MessagePriority::CONTROL, 16));
+
+    EXPECT_EQ(queue.pop()->header.priority, Network::MessagePriority::CONTROL);
+    EXPECT_EQ(static_cast<int>(queue.pop()->header.priority), 200);
+    EXPECT_FALSE(queue.pop());
+    EXPECT_TRUE(queue.empty());
+}
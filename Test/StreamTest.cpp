@@ -0,0 +1,375 @@
+#include <gtest/gtest.h>
+
+#include <Network/Connection.hpp>
+#include <future>
+
+class StreamTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        acceptor.open(boost::asio::ip::tcp::v4());
+        acceptor.bind(boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+        acceptor.listen();
+        serviceThread = std::thread([this]() { service.run(); });
+    }
+
+    void TearDown() override
+    {
+        work.reset();
+        service.stop();
+        serviceThread.join();
+
+        connections.clear();
+        serverIn.clear();
+        clientIn.clear();
+    }
+
+    std::shared_ptr<Network::Connection> acceptServerConnection(Network::ConnectionConfig config = {})
+    {
+        auto connection = std::make_shared<Network::Connection>(Network::Connection::OwnerType::SERVER, service,
+                                                                Network::Connection::Socket(acceptor.accept()), serverIn, nullptr, config);
+        connection->setOnClose([this](const std::error_code& reason) {
+            closeReason = reason;
+            serverClosed.set_value();
+        });
+        connection->connectToClient();
+        connections.push_back(connection);
+        return connection;
+    }
+
+    std::shared_ptr<Network::Connection> connectClient(Network::ConnectionConfig config = {})
+    {
+        auto connection = std::make_shared<Network::Connection>(Network::Connection::OwnerType::CLIENT, service,
+                                                                Network::Connection::Socket(service), clientIn, nullptr, config);
+        connection->connectToServer(std::vector<Network::Connection::Endpoint>{acceptor.local_endpoint()});
+        connections.push_back(connection);
+        return connection;
+    }
+
+    // Writes a frame as a peer which does not follow the protocol would
+    static void writeFrame(boost::asio::ip::tcp::socket& socket, uint8_t flags, uint32_t size)
+    {
+        Network::MessageHeader header;
+        header.id    = Network::MessageType::MessageStoreRequest;
+        header.flags = flags;
+        header.size  = size;
+        const std::vector<uint8_t> body(size);
+        boost::asio::write(socket, std::array<boost::asio::const_buffer, 2>{boost::asio::buffer(&header, sizeof(header)), boost::asio::buffer(body)});
+    }
+
+    bool waitServerClosed() { return serverClosed.get_future().wait_for(std::chrono::seconds(5)) == std::future_status::ready; }
+
+    boost::asio::io_service service;
+    boost::asio::executor_work_guard<boost::asio::io_service::executor_type> work = boost::asio::make_work_guard(service);
+    std::thread serviceThread;
+    boost::asio::ip::tcp::acceptor acceptor{service};
+
+    std::vector<std::shared_ptr<Network::Connection>> connections;
+    Network::SafeQueue<Network::Message> serverIn, clientIn;
+    std::promise<void> serverClosed;
+    std::error_code closeReason;  // is set before serverClosed
+};
+
+// A payload much larger than the frame limit arrives in order, while the receiver never holds more than a stream window of it
+TEST_F(StreamTest, LargeMessageIsStreamedWithinWindow)
+{
+    std::vector<uint8_t> payload(8u * 1024u * 1024u);
+    for (std::size_t i = 0; i < payload.size(); ++i)
+    {
+        payload[i] = static_cast<uint8_t>(i * 7 + i / 4096);
+    }
+
+    auto client = connectClient();
+    auto server = acceptServerConnection();
+
+    // A stream never takes the CONTROL lane whatever the priority of the message is
+    Network::Message msg;
+    msg.header.id       = Network::MessageType::MessageStoreRequest;
+    msg.header.priority = Network::MessagePriority::CONTROL;
+    msg.body            = payload;
+    client->send(msg);
+
+    std::vector<uint8_t> received;
+    std::size_t maxQueued = 0;
+    while (true)
+    {
+        serverIn.wait();
+        // Chunks are consumed slowly, so the sender has to wait for the credit
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        maxQueued = std::max(maxQueued, serverIn.size());
+
+        const auto chunk = serverIn.pop_front();
+        ASSERT_TRUE(chunk.isStreamChunk());
+        EXPECT_EQ(chunk.header.id, Network::MessageType::MessageStoreRequest);
+        EXPECT_EQ(chunk.header.priority, Network::MessagePriority::BULK);
+        EXPECT_LE(chunk.body.size(), Network::Connection::STREAM_CHUNK_SIZE);
+        received.insert(received.end(), chunk.body.begin(), chunk.body.end());
+        if (chunk.isStreamEnd())
+        {
+            break;
+        }
+    }
+
+    EXPECT_TRUE(received == payload);
+    // The empty last chunk may come on top of a full window
+    EXPECT_LE(maxQueued, Network::Connection::STREAM_WINDOW / Network::Connection::STREAM_CHUNK_SIZE + 1);
+}
+
+TEST_F(StreamTest, ControlMessageOvertakesStream)
+{
+    auto client = connectClient();
+
+    client->sendStream(Network::MessageType::MessageStoreRequest, std::vector<uint8_t>(4u * 1024u * 1024u));
+    Network::Message login;
+    login.header.id       = Network::MessageType::LoginRequest;
+    login.header.priority = Network::MessagePriority::CONTROL;
+    client->send(login);
+
+    auto server = acceptServerConnection();
+
+    bool loginReceived = false;
+    while (true)
+    {
+        serverIn.wait();
+        const auto msg = serverIn.pop_front();
+        if (msg.header.id == Network::MessageType::LoginRequest)
+        {
+            loginReceived = true;
+        }
+        else if (msg.isStreamEnd())
+        {
+            break;
+        }
+    }
+    EXPECT_TRUE(loginReceived);
+}
+
+// Pending handlers keep the connection alive after its owner has dropped it
+TEST_F(StreamTest, ConnectionOutlivesItsOwner)
+{
+    {
+        auto client = std::make_shared<Network::Connection>(Network::Connection::OwnerType::CLIENT, service,
+                                                            Network::Connection::Socket(service), clientIn);
+        client->connectToServer(std::vector<Network::Connection::Endpoint>{acceptor.local_endpoint()});
+
+        Network::Message login;
+        login.header.id = Network::MessageType::LoginRequest;
+        login << uint32_t{42};
+        client->send(login);
+    }
+
+    auto server = acceptServerConnection();
+    serverIn.wait();
+    const auto msg = serverIn.pop_front();
+    EXPECT_EQ(msg.header.id, Network::MessageType::LoginRequest);
+    EXPECT_EQ(msg.body.size(), sizeof(uint32_t));
+}
+
+TEST_F(StreamTest, OversizedFrameClosesConnection)
+{
+    boost::asio::ip::tcp::socket peer(service);
+    peer.connect(acceptor.local_endpoint());
+
+    Network::ConnectionConfig config;
+    config.maxFrameSize = 1024;
+    auto server         = acceptServerConnection(config);
+
+    writeFrame(peer, 0, 512);
+    // The body is never allocated: the connection is closed as soon as the header is read
+    Network::MessageHeader header;
+    header.id   = Network::MessageType::MessageStoreRequest;
+    header.size = 0xFFFFFFFFu;
+    boost::asio::write(peer, boost::asio::buffer(&header, sizeof(header)));
+
+    ASSERT_TRUE(waitServerClosed());
+    EXPECT_EQ(closeReason, std::errc::protocol_error);
+    ASSERT_EQ(serverIn.size(), 1u);
+    EXPECT_EQ(serverIn.pop_front().body.size(), 512u);
+}
+
+TEST_F(StreamTest, ChunksBeyondCreditCloseConnection)
+{
+    boost::asio::ip::tcp::socket peer(service);
+    peer.connect(acceptor.local_endpoint());
+    auto server = acceptServerConnection();
+
+    // Received chunks are kept in the queue, so no credit is returned
+    for (std::size_t sent = 0; sent < Network::Connection::STREAM_WINDOW; sent += Network::Connection::STREAM_CHUNK_SIZE)
+    {
+        writeFrame(peer, Network::MessageFlags::STREAM_CHUNK, Network::Connection::STREAM_CHUNK_SIZE);
+    }
+    writeFrame(peer, Network::MessageFlags::STREAM_CHUNK, 1);
+
+    ASSERT_TRUE(waitServerClosed());
+    EXPECT_EQ(serverIn.size(), Network::Connection::STREAM_WINDOW / Network::Connection::STREAM_CHUNK_SIZE);
+}
+
+// With a frame limit below STREAM_CHUNK_SIZE chunks are cut to the limit, and a larger chunk is rejected
+TEST_F(StreamTest, ChunksFollowFrameLimit)
+{
+    Network::ConnectionConfig config;
+    config.maxFrameSize = 1024;
+
+    auto client = connectClient(config);
+    auto server = acceptServerConnection(config);
+
+    std::vector<uint8_t> payload(100u * 1024u + 10u);
+    for (std::size_t i = 0; i < payload.size(); ++i)
+    {
+        payload[i] = static_cast<uint8_t>(i % 251);
+    }
+    client->sendStream(Network::MessageType::MessageStoreRequest, payload);
+
+    std::vector<uint8_t> received;
+    while (true)
+    {
+        serverIn.wait();
+        const auto chunk = serverIn.pop_front();
+        ASSERT_TRUE(chunk.isStreamChunk());
+        EXPECT_LE(chunk.body.size(), config.maxFrameSize);
+        received.insert(received.end(), chunk.body.begin(), chunk.body.end());
+        if (chunk.isStreamEnd())
+        {
+            break;
+        }
+    }
+    EXPECT_TRUE(received == payload);
+}
+
+TEST_F(StreamTest, ChunkAboveFrameLimitClosesConnection)
+{
+    boost::asio::ip::tcp::socket peer(service);
+    peer.connect(acceptor.local_endpoint());
+
+    Network::ConnectionConfig config;
+    config.maxFrameSize = 1024;
+    auto server         = acceptServerConnection(config);
+
+    // Within the credit of the stream, but larger than a frame may be
+    writeFrame(peer, Network::MessageFlags::STREAM_CHUNK, 1024);
+    writeFrame(peer, Network::MessageFlags::STREAM_CHUNK, 2048);
+
+    ASSERT_TRUE(waitServerClosed());
+    EXPECT_EQ(closeReason, std::errc::protocol_error);
+    ASSERT_EQ(serverIn.size(), 1u);
+    EXPECT_EQ(serverIn.pop_front().body.size(), 1024u);
+}
+
+// An empty chunk uses no credit, so only the last one of a stream may be empty
+TEST_F(StreamTest, EmptyChunkClosesConnection)
+{
+    boost::asio::ip::tcp::socket peer(service);
+    peer.connect(acceptor.local_endpoint());
+    auto server = acceptServerConnection();
+
+    writeFrame(peer, Network::MessageFlags::STREAM_CHUNK | Network::MessageFlags::STREAM_END, 0);
+    writeFrame(peer, Network::MessageFlags::STREAM_CHUNK, 0);
+
+    ASSERT_TRUE(waitServerClosed());
+    EXPECT_EQ(closeReason, std::errc::protocol_error);
+    ASSERT_EQ(serverIn.size(), 1u);
+    EXPECT_TRUE(serverIn.pop_front().isStreamEnd());
+}
+
+// Empty frames are counted with the memory they take in the queue, not only with their bytes on the wire
+TEST_F(StreamTest, EmptyFramesAreBounded)
+{
+    static constexpr std::size_t MESSAGES_COUNT = 20000;
+
+    Network::ConnectionConfig config;
+    config.maxQueuedBytes = 64u * 1024u;
+
+    boost::asio::ip::tcp::socket peer(service);
+    peer.connect(acceptor.local_endpoint());
+    auto server = acceptServerConnection(config);
+
+    std::thread writer([&peer]() {
+        for (std::size_t i = 0; i < MESSAGES_COUNT; ++i)
+        {
+            writeFrame(peer, 0, 0);
+        }
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    // The budget may be exceeded by one frame only, whatever else is in the receive buffer
+    const std::size_t messageCost = sizeof(Network::MessageHeader) + Network::Connection::QUEUED_MESSAGE_OVERHEAD;
+    EXPECT_LE(serverIn.size(), config.maxQueuedBytes / messageCost + 1);
+
+    for (std::size_t received = 0; received < MESSAGES_COUNT; ++received)
+    {
+        serverIn.wait();
+        serverIn.pop_front();
+    }
+    writer.join();
+}
+
+// A receiver which does not keep up stops reading, so its queue stays within the budget until it catches up
+TEST_F(StreamTest, ReceiveQueueIsBounded)
+{
+    static constexpr std::size_t MESSAGES_COUNT = 200;
+    static constexpr std::size_t MESSAGE_SIZE   = 4096;
+
+    Network::ConnectionConfig config;
+    config.maxQueuedBytes = 64u * 1024u;
+
+    auto client = connectClient();
+    auto server = acceptServerConnection(config);
+
+    Network::Message msg;
+    msg.header.id = Network::MessageType::MessageStoreRequest;
+    msg.body.resize(MESSAGE_SIZE);
+    for (std::size_t i = 0; i < MESSAGES_COUNT; ++i)
+    {
+        client->send(msg);
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    // The budget may be exceeded by one frame
+    EXPECT_LE(serverIn.size(), config.maxQueuedBytes / (msg.getSize() + Network::Connection::QUEUED_MESSAGE_OVERHEAD) + 1);
+    EXPECT_LT(serverIn.size(), MESSAGES_COUNT);
+
+    for (std::size_t received = 0; received < MESSAGES_COUNT; ++received)
+    {
+        serverIn.wait();
+        EXPECT_EQ(serverIn.pop_front().body.size(), MESSAGE_SIZE);
+    }
+}
+
+// More streams than MAX_STREAMS: the later ones wait for ids which are freed when the receiver has consumed a stream
+TEST_F(StreamTest, StreamIdsAreReused)
+{
+    static constexpr std::size_t STREAMS_COUNT = 3 * Network::Connection::MAX_STREAMS;
+    static constexpr std::size_t STREAM_SIZE   = Network::Connection::STREAM_WINDOW + 1000;
+
+    auto client = connectClient();
+    auto server = acceptServerConnection();
+    for (std::size_t i = 0; i < STREAMS_COUNT; ++i)
+    {
+        client->sendStream(Network::MessageType::MessageStoreRequest, std::vector<uint8_t>(STREAM_SIZE, static_cast<uint8_t>(i)));
+    }
+
+    std::map<uint8_t, std::vector<uint8_t>> streams;
+    std::vector<uint8_t> finished;
+    while (finished.size() < STREAMS_COUNT)
+    {
+        serverIn.wait();
+        const auto chunk = serverIn.pop_front();
+        ASSERT_TRUE(chunk.isStreamChunk());
+
+        auto& stream = streams[chunk.header.stream];
+        stream.insert(stream.end(), chunk.body.begin(), chunk.body.end());
+        if (chunk.isStreamEnd())
+        {
+            ASSERT_EQ(stream.size(), STREAM_SIZE);
+            finished.push_back(stream.front());
+            streams.erase(chunk.header.stream);
+        }
+    }
+
+    std::sort(finished.begin(), finished.end());
+    for (std::size_t i = 0; i < STREAMS_COUNT; ++i)
+    {
+        EXPECT_EQ(finished[i], i);
+    }
+}
@@ -0,0 +1,267 @@
+#include <gtest/gtest.h>
+
+#include <Server.hpp>
+#include <TopicIndex.hpp>
+#include <random>
+
+struct FakeSubscriber
+{
+    bool isConnected() const { return connected; }
+
+    std::atomic<bool> connected = true;
+    std::size_t received        = 0;
+};
+
+TEST(TopicIndexTest, PublishVisitsSubscribersOfTopicOnly)
+{
+    TopicIndex<FakeSubscriber> index;
+    std::vector<std::shared_ptr<FakeSubscriber>> subscribers;
+    for (int i = 0; i < 10; ++i)
+    {
+        subscribers.push_back(std::make_shared<FakeSubscriber>());
+        EXPECT_TRUE(index.subscribe(i % 2, subscribers.back()));
+    }
+    EXPECT_FALSE(index.subscribe(0, subscribers[0]));
+
+    auto deliver = [](FakeSubscriber& subscriber) { ++subscriber.received; };
+    EXPECT_EQ(index.forEachSubscriber(0, nullptr, deliver), 5u);
+    EXPECT_EQ(index.forEachSubscriber(1, subscribers[1].get(), deliver), 4u);
+    EXPECT_EQ(index.forEachSubscriber(2, nullptr, deliver), 0u);
+
+    EXPECT_EQ(subscribers[0]->received, 1u);
+    EXPECT_EQ(subscribers[1]->received, 0u);
+    EXPECT_EQ(subscribers[3]->received, 1u);
+}
+
+TEST(TopicIndexTest, UnsubscribeAndDisconnect)
+{
+    TopicIndex<FakeSubscriber> index;
+    auto first  = std::make_shared<FakeSubscriber>();
+    auto second = std::make_shared<FakeSubscriber>();
+
+    for (uint64_t topic = 0; topic < 3; ++topic)
+    {
+        index.subscribe(topic, first);
+        index.subscribe(topic, second);
+    }
+
+    EXPECT_TRUE(index.unsubscribe(1, first.get()));
+    EXPECT_FALSE(index.unsubscribe(1, first.get()));
+    EXPECT_EQ(index.getSubscribersCount(1), 1u);
+
+    // The index holds no references to a disconnected subscriber
+    second->connected = false;
+    index.unsubscribeAll(second.get());
+    EXPECT_FALSE(index.subscribe(0, second));
+    EXPECT_EQ(second.use_count(), 1);
+
+    EXPECT_EQ(index.getSubscribersCount(0), 1u);
+    EXPECT_EQ(index.getSubscribersCount(1), 0u);
+    EXPECT_EQ(index.getSubscribersCount(2), 1u);
+}
+
+TEST(TopicIndexTest, SubscriptionsOfSubscriberAreLimited)
+{
+    TopicIndex<FakeSubscriber> index(3);
+    auto subscriber = std::make_shared<FakeSubscriber>();
+    auto other      = std::make_shared<FakeSubscriber>();
+
+    for (uint64_t topic = 0; topic < 3; ++topic)
+    {
+        EXPECT_TRUE(index.subscribe(topic, subscriber));
+    }
+    EXPECT_FALSE(index.subscribe(3, subscriber));
+    EXPECT_EQ(index.getSubscribersCount(3), 0u);
+
+    // The limit is per subscriber and an unsubscribe frees a place
+    EXPECT_TRUE(index.subscribe(3, other));
+    EXPECT_TRUE(index.unsubscribe(0, subscriber.get()));
+    EXPECT_TRUE(index.subscribe(3, subscriber));
+    EXPECT_EQ(index.getSubscribersCount(3), 2u);
+
+    // Without any subscriptions allowed nothing of the subscriber is kept
+    TopicIndex<FakeSubscriber> closedIndex(0);
+    EXPECT_FALSE(closedIndex.subscribe(0, subscriber));
+    closedIndex.unsubscribeAll(subscriber.get());
+    EXPECT_EQ(closedIndex.getSubscribersCount(0), 0u);
+}
+
+// Every thread churns its own subscribers while another one publishes, so the final subscriptions are known
+TEST(TopicIndexTest, ConcurrentPublishAndChurn)
+{
+    static constexpr std::size_t THREADS_COUNT     = 4;
+    static constexpr std::size_t SUBSCRIBERS_COUNT = 100;
+    static constexpr uint64_t TOPICS_COUNT         = 50;
+
+    TopicIndex<FakeSubscriber> index;
+    std::vector<std::vector<uint64_t>> expected(THREADS_COUNT, std::vector<uint64_t>(TOPICS_COUNT));
+    std::atomic<bool> churning = true;
+
+    std::vector<std::thread> churners;
+    for (std::size_t t = 0; t < THREADS_COUNT; ++t)
+    {
+        churners.emplace_back([&, t]() {
+            std::mt19937_64 random(t);
+            std::vector<std::shared_ptr<FakeSubscriber>> subscribers;
+            for (std::size_t i = 0; i < SUBSCRIBERS_COUNT; ++i)
+            {
+                subscribers.push_back(std::make_shared<FakeSubscriber>());
+            }
+            std::vector<std::vector<bool>> subscribed(SUBSCRIBERS_COUNT, std::vector<bool>(TOPICS_COUNT));
+
+            for (int i = 0; i < 20000; ++i)
+            {
+                const std::size_t subscriber = random() % SUBSCRIBERS_COUNT;
+                const uint64_t topic         = random() % TOPICS_COUNT;
+                if (subscribed[subscriber][topic])
+                {
+                    EXPECT_TRUE(index.unsubscribe(topic, subscribers[subscriber].get()));
+                }
+                else
+                {
+                    EXPECT_TRUE(index.subscribe(topic, subscribers[subscriber]));
+                }
+                subscribed[subscriber][topic] = !subscribed[subscriber][topic];
+            }
+
+            // Half of the subscribers disconnect
+            for (std::size_t subscriber = 0; subscriber < SUBSCRIBERS_COUNT; ++subscriber)
+            {
+                if (subscriber % 2 == 0)
+                {
+                    subscribers[subscriber]->connected = false;
+                    index.unsubscribeAll(subscribers[subscriber].get());
+                    continue;
+                }
+                for (uint64_t topic = 0; topic < TOPICS_COUNT; ++topic)
+                {
+                    expected[t][topic] += subscribed[subscriber][topic];
+                }
+            }
+        });
+    }
+
+    std::size_t delivered = 0;
+    std::thread publisher([&]() {
+        uint64_t topic = 0;
+        while (churning)
+        {
+            delivered += index.forEachSubscriber(topic++ % TOPICS_COUNT, nullptr, [](FakeSubscriber&) {});
+        }
+    });
+
+    for (auto& churner : churners)
+    {
+        churner.join();
+    }
+    churning = false;
+    publisher.join();
+    EXPECT_GT(delivered, 0u);
+
+    for (uint64_t topic = 0; topic < TOPICS_COUNT; ++topic)
+    {
+        std::size_t subscribersCount = 0;
+        for (std::size_t t = 0; t < THREADS_COUNT; ++t)
+        {
+            subscribersCount += expected[t][topic];
+        }
+        EXPECT_EQ(index.getSubscribersCount(topic), subscribersCount);
+    }
+}
+
+// Waits for the next message of the type, skipping the others
+static Network::Message waitMessage(Network::SafeQueue<Network::Message>& queue, Network::MessageType type)
+{
+    while (true)
+    {
+        queue.wait();
+        auto msg = queue.pop_front();
+        if (msg.header.id == type)
+        {
+            return msg;
+        }
+    }
+}
+
+TEST(ServerTopicTest, PublishReachesSubscribersOnly)
+{
+    static constexpr uint64_t TOPIC = 7;
+
+    MessageLogConfig logConfig;
+    logConfig.directory = std::filesystem::temp_directory_path() / ("ServerTopicTest-" + std::to_string(getpid()));
+
+    {
+        Server server(0, logConfig);
+        server.setLocalSocketPath("");
+        ASSERT_TRUE(server.start());
+
+        std::atomic<bool> running = true;
+        std::thread updater([&]() {
+            while (running)
+            {
+                server.update();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+
+        boost::asio::io_service clientService;
+        auto work = boost::asio::make_work_guard(clientService);
+        std::thread clientThread([&]() { clientService.run(); });
+
+        const std::vector<Network::Connection::Endpoint> endpoints{
+            boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), server.getPort())};
+        std::vector<std::unique_ptr<Network::SafeQueue<Network::Message>>> queues;
+        std::vector<std::shared_ptr<Network::Connection>> clients;
+        for (int i = 0; i < 4; ++i)
+        {
+            queues.push_back(std::make_unique<Network::SafeQueue<Network::Message>>());
+            clients.push_back(std::make_shared<Network::Connection>(Network::Connection::OwnerType::CLIENT, clientService,
+                                                                    Network::Connection::Socket(clientService), *queues.back()));
+            clients.back()->connectToServer(endpoints);
+            waitMessage(*queues.back(), Network::MessageType::ServerAcceptAnswer);
+        }
+
+        // The first three clients subscribe, the last one publishes
+        for (int i = 0; i < 3; ++i)
+        {
+            Network::Message subscribe;
+            subscribe.header.id = Network::MessageType::SubscribeRequest;
+            subscribe << TOPIC;
+            clients[i]->send(subscribe);
+            EXPECT_EQ(waitMessage(*queues[i], Network::MessageType::SubscribeAnswer).body, std::vector<uint8_t>{1});
+        }
+
+        Network::Message unsubscribe;
+        unsubscribe.header.id = Network::MessageType::UnsubscribeRequest;
+        unsubscribe << TOPIC;
+        clients[2]->send(unsubscribe);
+        EXPECT_EQ(waitMessage(*queues[2], Network::MessageType::UnsubscribeAnswer).body, std::vector<uint8_t>{1});
+
+        Network::Message publish;
+        publish.header.id = Network::MessageType::PublishRequest;
+        publish << uint32_t{42} << TOPIC;
+        clients[3]->send(publish);
+
+        auto answer        = waitMessage(*queues[3], Network::MessageType::PublishAnswer);
+        uint32_t delivered = 0;
+        answer >> delivered;
+        EXPECT_EQ(delivered, 2u);
+
+        for (int i = 0; i < 2; ++i)
+        {
+            EXPECT_EQ(waitMessage(*queues[i], Network::MessageType::TopicMessage).body, publish.body);
+        }
+        EXPECT_TRUE(queues[2]->empty());
+
+        running = false;
+        updater.join();
+        server.stop();
+
+        work.reset();
+        clientService.stop();
+        clientThread.join();
+        clients.clear();
+    }
+
+    std::filesystem::remove_all(logConfig.directory);
+}